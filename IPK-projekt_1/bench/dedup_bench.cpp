@@ -0,0 +1,76 @@
+/**
+* @file dedup_bench.cpp
+* @brief Soak benchmark of the duplicate detection of server message IDs
+*
+* Feeds millions of inbound message IDs (sequential with wraparound, 10 %
+* duplicates and occasional reordering) through DuplicateWindow and compares
+* the cost per message with the former std::vector + std::find lookup.
+*/
+#include "../dedup.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+// Inbound stream as the server would send it with a lossy network in between
+static vector<uint16_t> makeStream(size_t count) {
+    mt19937 random(42);
+    vector<uint16_t> stream;
+    stream.reserve(count);
+    uint16_t next = 0;
+    while (stream.size() < count) {
+        stream.push_back(next);
+        unsigned roll = random() % 100;
+        if (roll < 10) {
+            // Retransmission of an already received message
+            stream.push_back(next - random() % 8);
+        } else if (roll < 12 && stream.size() >= 2) {
+            // Two messages swapped on the way
+            swap(stream[stream.size() - 1], stream[stream.size() - 2]);
+        }
+        ++next;
+    }
+    stream.resize(count);
+    return stream;
+}
+
+int main() {
+    const size_t soakCount = 20000000;
+    const size_t legacyCount = 50000;
+    vector<uint16_t> stream = makeStream(soakCount);
+
+    DuplicateWindow window;
+    size_t duplicates = 0;
+    auto start = chrono::steady_clock::now();
+    for (uint16_t id : stream) {
+        if (window.contains(id)) {
+            ++duplicates;
+        } else {
+            window.insert(id);
+        }
+    }
+    double windowSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<int> messageIDsFromServer;
+    size_t legacyDuplicates = 0;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < legacyCount; ++i) {
+        uint16_t id = stream[i];
+        if (find(messageIDsFromServer.begin(), messageIDsFromServer.end(), id) != messageIDsFromServer.end()) {
+            ++legacyDuplicates;
+        } else {
+            messageIDsFromServer.push_back(id);
+        }
+    }
+    double legacySeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "DuplicateWindow: " << soakCount << " messages, " << duplicates << " duplicates, "
+         << windowSeconds * 1e9 / soakCount << " ns/message, " << sizeof(DuplicateWindow) << " bytes" << endl;
+    cout << "vector + find:   " << legacyCount << " messages, " << legacyDuplicates << " duplicates, "
+         << legacySeconds * 1e9 / legacyCount << " ns/message, " << messageIDsFromServer.size() * sizeof(int) << " bytes" << endl;
+    return 0;
+}
@@ -0,0 +1,381 @@
+/**
+* @file micro_bench.cpp
+* @brief Microbenchmarks of the per-message hot paths of the client
+*
+* Times the TCP line parser, the UDP datagram decoder, the CONFIRM handling,
+* both encoders, the session and the field validation over realistic messages.
+* The validators are compared with the std::regex checks they replaced, the
+* vectorized scanners with memchr and with each other (scalar, sse2, avx2).
+* Every result is one line in the format of Go benchmarks (and benchstat):
+*
+*     BenchmarkName/case  iterations  ns/op  B/op  allocs/op
+*
+* so results of two releases can be compared with benchstat or plain diff.
+* An optional argument runs only the benchmarks whose name contains it.
+*/
+#include "../codec.hpp"
+#include "../parser.hpp"
+#include "../scan.hpp"
+#include "../session.hpp"
+#include "../udp.hpp"
+#include "../validate.hpp"
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <regex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Allocations of the whole process, counted by the replaced operator new
+static size_t allocations = 0;
+static size_t allocatedBytes = 0;
+
+// Every replaced operator new allocates here and every operator delete frees here.
+// Out of line, so that GCC does not see free called on the result of operator
+// new and report the pairs as mismatched (-Wmismatched-new-delete)
+__attribute__((noinline)) static void* countedAllocate(size_t size, size_t alignment) {
+    ++allocations;
+    allocatedBytes += size;
+    size = size == 0 ? 1 : size;
+    if (alignment <= alignof(max_align_t)) {
+        return malloc(size);
+    }
+    // aligned_alloc wants a multiple of the alignment
+    return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+__attribute__((noinline)) static void countedRelease(void* memory) {
+    free(memory);
+}
+
+void* operator new(size_t size) {
+    void* memory = countedAllocate(size, 0);
+    if (memory == nullptr) {
+        throw bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new(size_t size, align_val_t alignment) {
+    void* memory = countedAllocate(size, static_cast<size_t>(alignment));
+    if (memory == nullptr) {
+        throw bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept {
+    return countedAllocate(size, 0);
+}
+
+void* operator new(size_t size, align_val_t alignment, const nothrow_t&) noexcept {
+    return countedAllocate(size, static_cast<size_t>(alignment));
+}
+
+// The array forms call the ones above, the deletes of all forms end in countedRelease
+
+void operator delete(void* memory) noexcept {
+    countedRelease(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    countedRelease(memory);
+}
+
+void operator delete(void* memory, align_val_t) noexcept {
+    countedRelease(memory);
+}
+
+void operator delete(void* memory, size_t, align_val_t) noexcept {
+    countedRelease(memory);
+}
+
+void operator delete(void* memory, const nothrow_t&) noexcept {
+    countedRelease(memory);
+}
+
+void operator delete(void* memory, align_val_t, const nothrow_t&) noexcept {
+    countedRelease(memory);
+}
+
+// Keeps the compiler from dropping the measured work
+static size_t sink = 0;
+
+static const char* filter = nullptr;
+
+/**
+* @brief Runs @p body with growing iteration counts until one run takes at least 200 ms, then prints the result.
+* @param name Benchmark name including the case.
+* @param body Executes the measured operation once.
+*/
+static void run(const string &name, const function<void()> &body) {
+    if (filter != nullptr && name.find(filter) == string::npos) {
+        return;
+    }
+    // Warm up, so that buffers reused by the operation are already grown
+    body();
+    size_t iterations = 1;
+    while (true) {
+        size_t allocationsBefore = allocations;
+        size_t bytesBefore = allocatedBytes;
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i) {
+            body();
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (seconds >= 0.2 || iterations >= 1000000000) {
+            printf("Benchmark%s\t%zu\t%.1f ns/op\t%zu B/op\t%zu allocs/op\n", name.c_str(), iterations,
+                   seconds * 1e9 / iterations, (allocatedBytes - bytesBefore) / iterations,
+                   (allocations - allocationsBefore) / iterations);
+            fflush(stdout);
+            return;
+        }
+        // Aim at 300 ms from the measured speed, at most 100x more per round
+        size_t next = seconds > 0 ? static_cast<size_t>(iterations * 0.3 / seconds) : iterations * 100;
+        iterations = max(iterations + 1, min(next, iterations * 100));
+    }
+}
+
+// The /auth check before the constexpr validators, regexes compiled once
+static bool regexCredentials(const string &username, const string &secret, const string &displayName) {
+    static const regex usernameRegex("[A-Za-z0-9\\-]{1,20}");
+    static const regex secretRegex("[A-Za-z0-9\\-]{1,128}");
+    static const regex displayNameRegex("[\\x21-\\x7E]{1,20}");
+    return regex_match(username, usernameRegex) && regex_match(secret, secretRegex)
+        && regex_match(displayName, displayNameRegex);
+}
+
+// The original check of TCP and UDP startCommunication, regexes compiled on every /auth
+static bool regexCredentialsCompiled(const string &username, const string &secret, const string &displayName) {
+    regex usernameRegex("[A-Za-z0-9\\-]{1,20}");
+    regex secretRegex("[A-Za-z0-9\\-]{1,128}");
+    regex displayNameRegex("[\\x21-\\x7E]{1,20}");
+    return regex_match(username, usernameRegex) && regex_match(secret, secretRegex)
+        && regex_match(displayName, displayNameRegex);
+}
+
+// Builds a server datagram: type, MessageID 1, then the given bytes
+static string datagram(uint8_t type, const string &rest) {
+    return string(1, static_cast<char>(type)) + string("\x00\x01", 2) + rest;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        filter = argv[1];
+    }
+    const string longContent(1400, 'x');
+    const string chatLine = "hello there, how is everyone doing today?";
+
+    // Lines of the TCP text grammar as the server sends them, without CRLF
+    const vector<pair<string, string>> lines = {
+        {"msg", "MSG FROM alice IS " + chatLine},
+        {"msg-long", "MSG FROM bob-the-builder IS " + longContent},
+        {"reply", "REPLY OK IS Join success."},
+        {"err", "ERR FROM Server IS Too many messages."},
+        {"bye", "BYE"},
+        {"invalid", "MSG FROM alice " + chatLine},
+    };
+    for (const auto &[caseName, line] : lines) {
+        run("ParseServerMessage/" + caseName, [&line = line]() {
+            ServerMessage message;
+            parseServerMessage(line, message);
+            sink += message.content.size();
+        });
+    }
+
+    // The same messages as UDP datagrams
+    const vector<pair<string, string>> datagrams = {
+        {"msg", datagram(0x04, string("alice\0", 6) + chatLine + string(1, '\0'))},
+        {"msg-long", datagram(0x04, string("bob-the-builder\0", 16) + longContent + string(1, '\0'))},
+        {"reply", datagram(0x01, string("\x01\x00\x02", 3) + string("Join success.\0", 14))},
+        {"err", datagram(0xFE, string("Server\0Too many messages.\0", 26))},
+        {"bye", datagram(0xFF, "")},
+        {"invalid", datagram(0x04, string("alice\0", 6) + chatLine)},
+    };
+    for (const auto &[caseName, data] : datagrams) {
+        run("DecodeDatagram/" + caseName, [&data = data]() {
+            ServerMessage message;
+            uint16_t refMessageID = 0;
+            decodeDatagram(data.data(), data.size(), message, refMessageID);
+            sink += message.content.size() + refMessageID;
+        });
+    }
+
+    // Messages the session asks the transport to send
+    const vector<pair<string, ClientMessage>> messages = {
+        {"auth", {CLIENT_AUTH, "xlogin00", "c3b1fd7e-0f4a-4b6e-9f1c-3a0f1b2c4d5e", "Alice", "", ""}},
+        {"join", {CLIENT_JOIN, "", "", "Alice", "discord.general", ""}},
+        {"msg", {CLIENT_MSG, "", "", "Alice", "", chatLine}},
+        {"msg-long", {CLIENT_MSG, "", "", "Alice", "", longContent}},
+        {"err", {CLIENT_ERR, "", "", "Alice", "", "Invalid message from server"}},
+    };
+    string text;
+    for (const auto &[caseName, message] : messages) {
+        run("EncodeText/" + caseName, [&message = message, &text]() {
+            encodeText(message, text);
+            sink += text.size();
+        });
+    }
+    BufferPool pool;
+    for (const auto &[caseName, message] : messages) {
+        run("EncodeDatagram/" + caseName, [&message = message, &pool]() {
+            PacketBuffer* buffer = pool.acquire();
+            encodeDatagram(message, 1, *buffer);
+            sink += buffer->length;
+            pool.release(buffer);
+        });
+    }
+    // The same messages decoded back, as the mock server does with the lines of its clients
+    for (const auto &[caseName, message] : messages) {
+        string line;
+        encodeText(message, line);
+        line.resize(line.size() - 2);
+        run("DecodeText/" + caseName, [line]() {
+            ClientMessage decoded;
+            decodeText(line, decoded);
+            sink += decoded.displayName.size();
+        });
+    }
+
+    // A message is sent (slot and buffer taken) and its CONFIRM arrives
+    {
+        UDP udp;
+        udp.sockClose = -1;
+        udp.byeSent = true;
+        udp.r = 3;
+        udp.d = 250;
+        uint16_t id = 0;
+        run("HandleConfirm/msg", [&udp, &id]() {
+            MessageInfo* info = udp.sentMessages.add(id);
+            info->content = udp.pool.acquire();
+            info->retries = udp.r;
+            info->awaitsReply = false;
+            info->timer = chrono::steady_clock::now();
+            const char confirm[3] = {0x00, static_cast<char>(id >> 8), static_cast<char>(id & 0xFF)};
+            udp.handleConfirm(confirm);
+            ++id;
+        });
+        MessageHistograms histograms;
+        udp.histograms = &histograms;
+        run("HandleConfirm/msg-histograms", [&udp, &id]() {
+            MessageInfo* info = udp.sentMessages.add(id);
+            info->content = udp.pool.acquire();
+            info->retries = udp.r;
+            info->awaitsReply = false;
+            info->timer = chrono::steady_clock::now();
+            info->firstSent = info->timer;
+            const char confirm[3] = {0x00, static_cast<char>(id >> 8), static_cast<char>(id & 0xFF)};
+            udp.handleConfirm(confirm);
+            ++id;
+        });
+        udp.histograms = nullptr;
+    }
+
+    // Recording into the shared histograms of every sent message
+    {
+        Histogram histogram;
+        uint64_t value = 12345;
+        run("HistogramRecord", [&histogram, &value]() {
+            histogram.record(value);
+            value = value * 6364136223846793005ULL + 1442695040888963407ULL;
+            value >>= 40;
+        });
+        sink += histogram.count();
+    }
+
+    // Decoded messages passed to an authorized session
+    {
+        Session session;
+        session.userLine("/auth xlogin00 secret Alice");
+        ServerMessage replyOk = {KIND_REPLY, "", "Auth success.", true};
+        session.serverMessage(replyOk);
+        for (const auto &[caseName, line] : lines) {
+            if (caseName != "msg" && caseName != "msg-long") {
+                continue;
+            }
+            ServerMessage message;
+            parseServerMessage(line, message);
+            run("SessionServerMessage/" + caseName, [&session, message]() {
+                sink += session.serverMessage(message).size();
+            });
+        }
+        run("SessionUserLine/msg", [&session, &chatLine]() {
+            sink += session.userLine(chatLine).size();
+        });
+    }
+
+    // Parameters of /auth, valid ones and ones rejected by each rule
+    const vector<pair<string, array<string, 3>>> credentials = {
+        {"valid", {"xlogin00", "c3b1fd7e-0f4a-4b6e-9f1c-3a0f1b2c4d5e", "Alice"}},
+        {"valid-long-secret", {"xlogin00", string(128, 'a'), "Alice"}},
+        {"bad-username", {"x_login", "secret", "Alice"}},
+        {"bad-secret", {"xlogin00", string(129, 'a'), "Alice"}},
+        {"bad-displayname", {"xlogin00", "secret", "Alice Smith"}},
+    };
+    for (const auto &[caseName, fields] : credentials) {
+        run("ValidCredentials/" + caseName, [&fields = fields]() {
+            sink += validCredentials(fields[0], fields[1], fields[2]);
+        });
+        run("RegexCredentials/" + caseName, [&fields = fields]() {
+            sink += regexCredentials(fields[0], fields[1], fields[2]);
+        });
+    }
+    run("RegexCredentialsCompiled/valid", [&credentials]() {
+        const array<string, 3> &fields = credentials[0].second;
+        sink += regexCredentialsCompiled(fields[0], fields[1], fields[2]);
+    });
+
+    // Fields checked on every message sent or received
+    run("ValidContent/msg", [&chatLine]() {
+        sink += CONTENT_RULE.matches(chatLine);
+    });
+    run("ValidContent/msg-long", [&longContent]() {
+        sink += CONTENT_RULE.matches(longContent);
+    });
+    run("RegexContent/msg-long", [&longContent]() {
+        static const regex contentRegex("[\\x20-\\x7E]{1,1400}");
+        sink += regex_match(longContent, contentRegex);
+    });
+    run("ValidChannelID", []() {
+        sink += CHANNEL_RULE.matches("discord.general");
+    });
+
+    // Separators and printable ranges of a maximal message with every scan level
+    {
+        const string frame = "MSG FROM bob-the-builder IS " + longContent + "\r\n";
+        const char* contentEnd = longContent.data() + longContent.size();
+        ScanLevel best = scanLevel();
+        run("Memchr/nul-1400", [&longContent, contentEnd]() {
+            const void* found = memchr(longContent.data(), '\0', contentEnd - longContent.data());
+            sink += found == nullptr;
+        });
+        for (int level = SCAN_SCALAR; level <= best; ++level) {
+            setScanLevel(static_cast<ScanLevel>(level));
+            string name = scanLevelName(static_cast<ScanLevel>(level));
+            run("FindByte/" + name + "/nul-1400", [&longContent, contentEnd]() {
+                sink += findByte(longContent.data(), contentEnd, '\0') - longContent.data();
+            });
+            run("FindCRLF/" + name + "/frame-1400", [&frame]() {
+                sink += findCRLF(frame.data(), frame.data() + frame.size()) - frame.data();
+            });
+            run("BytesInRange/" + name + "/content-1400", [&longContent, contentEnd]() {
+                sink += bytesInRange(longContent.data(), contentEnd, 0x20, 0x7E);
+            });
+            run("ParseServerMessage/" + name + "/msg-long", [&lines]() {
+                ServerMessage message;
+                parseServerMessage(lines[1].second, message);
+                sink += message.content.size();
+            });
+        }
+        setScanLevel(best);
+    }
+
+    fprintf(stderr, "(checksum %zu)\n", sink);
+    return 0;
+}
@@ -0,0 +1,72 @@
+/**
+* @file parser_bench.cpp
+* @brief Microbenchmark of the TCP message parsing
+*
+* Compares the former stringstream/find_first_of parsing of TCP::nextState
+* with parseServerMessage over the same corpus of server messages.
+*/
+#include "../parser.hpp"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+
+using namespace std;
+
+// Parsing as it was done in TCP::nextState before parseServerMessage
+static size_t legacyParse(const string &serverResponse) {
+    stringstream ss(serverResponse);
+    string firstWord, secondWord, DNAME, fourthWord;
+    ss >> firstWord >> secondWord >> DNAME >> fourthWord;
+    if (firstWord == "MSG" && secondWord == "FROM" && fourthWord == "IS") {
+        string content = serverResponse.substr(serverResponse.find_first_of(" \t\r\n", serverResponse.find_first_of(" \t\r\n", serverResponse.find_first_of(" \t\r\n", serverResponse.find_first_of(" \t\r\n", serverResponse.find_first_of(" \t\r\n") + 1)) + 1) + 1));
+        return DNAME.size() + content.size();
+    }
+    if (firstWord == "REPLY" && (secondWord == "OK" || secondWord == "NOK") && DNAME == "IS") {
+        string content = serverResponse.substr(serverResponse.find_first_of(" \t\r\n", serverResponse.find_first_of(" \t\r\n", serverResponse.find_first_of(" \t\r\n") + 1) + 1));
+        return content.size();
+    }
+    return 0;
+}
+
+static size_t newParse(string_view line) {
+    ServerMessage message;
+    parseServerMessage(line, message);
+    return message.displayName.size() + message.content.size();
+}
+
+int main() {
+    vector<string> corpus = {
+        "MSG FROM alice IS hello there, how is everyone doing today?",
+        "MSG FROM bob-the-builder IS " + string(1200, 'x'),
+        "REPLY OK IS Join success.",
+        "MSG FROM Server IS carol has joined general.",
+        "REPLY NOK IS Channel is full.",
+    };
+    // The legacy parser worked on messages including the terminator
+    vector<string> legacyCorpus;
+    for (const string &line : corpus) {
+        legacyCorpus.push_back(line + "\r\n");
+    }
+
+    const size_t iterations = 500000;
+    size_t sink = 0;
+
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        sink += legacyParse(legacyCorpus[i % legacyCorpus.size()]);
+    }
+    double legacySeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        sink += newParse(corpus[i % corpus.size()]);
+    }
+    double newSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "stringstream parser: " << static_cast<long>(iterations / legacySeconds) << " messages/s" << endl;
+    cout << "parseServerMessage:  " << static_cast<long>(iterations / newSeconds) << " messages/s" << endl;
+    cout << "(checksum " << sink << ")" << endl;
+    return 0;
+}
@@ -0,0 +1,36 @@
+#include "codec.hpp"
+#include "schema.hpp"
+
+using namespace std;
+
+void encodeText(const ClientMessage &message, string &out){
+    ClientSchema::encodeText(message, out);
+}
+
+void encodeText(const ServerMessage &message, string &out){
+    ServerSchema::encodeText(message, out);
+}
+
+bool encodeDatagram(const ClientMessage &message, int messageID, PacketBuffer &out){
+    return ClientSchema::encodeDatagram(message, messageID, out);
+}
+
+bool encodeDatagram(const ServerMessage &message, int messageID, PacketBuffer &out){
+    return ServerSchema::encodeDatagram(message, messageID, out);
+}
+
+bool decodeDatagram(const char* data, size_t length, ServerMessage &message, uint16_t &refMessageID){
+    if (!ServerSchema::decodeDatagram(data, length, message)) {
+        return false;
+    }
+    refMessageID = message.refMessageID;
+    return true;
+}
+
+bool decodeDatagram(const char* data, size_t length, ClientMessage &message){
+    return ClientSchema::decodeDatagram(data, length, message);
+}
+
+bool decodeText(string_view line, ClientMessage &message){
+    return ClientSchema::decodeText(line, message);
+}
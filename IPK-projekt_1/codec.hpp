@@ -0,0 +1,86 @@
+/**
+* @file codec.hpp
+* @brief Encoders and decoders of the messages of both directions for both transports
+*
+* All of them are generated from the layouts in schema.hpp. The client encodes
+* ClientMessages and decodes ServerMessages, the mock server the other way round.
+*/
+#ifndef CODEC_HPP
+#define CODEC_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "parser.hpp"
+#include "pool.hpp"
+#include "session.hpp"
+
+/**
+* @brief Encodes a client message in the TCP text grammar.
+*
+* The previous content of @p out is replaced, its capacity is reused, so encoding
+* into the same string does not allocate once it has grown to the message size.
+*
+* @param message The message.
+* @param out Output, the message including the terminating CRLF.
+*/
+void encodeText(const ClientMessage &message, std::string &out);
+
+/**
+* @brief Encodes a server message in the TCP text grammar.
+* @param message The message.
+* @param out Output, the message including the terminating CRLF.
+*/
+void encodeText(const ServerMessage &message, std::string &out);
+
+/**
+* @brief Encodes a client message as a UDP datagram.
+* @param message The message.
+* @param messageID ID written into the header.
+* @param out Output buffer.
+* @return false if the message does not fit into the buffer.
+*/
+bool encodeDatagram(const ClientMessage &message, int messageID, PacketBuffer &out);
+
+/**
+* @brief Encodes a server message as a UDP datagram, a REPLY includes refMessageID.
+* @param message The message.
+* @param messageID ID written into the header.
+* @param out Output buffer.
+* @return false if the message does not fit into the buffer.
+*/
+bool encodeDatagram(const ServerMessage &message, int messageID, PacketBuffer &out);
+
+/**
+* @brief Decodes a REPLY, MSG, ERR or BYE datagram from the server.
+*
+* Every field is searched for only within @p length, the views of @p message point
+* into @p data.
+*
+* @param data The datagram, at least 3 bytes.
+* @param length Size of the datagram.
+* @param message Output structure, KIND_INVALID if the datagram is malformed.
+* @param refMessageID Output, ID of the answered message (REPLY only).
+* @return true if the datagram was decoded.
+*/
+bool decodeDatagram(const char* data, size_t length, ServerMessage &message, uint16_t &refMessageID);
+
+/**
+* @brief Decodes an AUTH, JOIN, MSG, ERR or BYE datagram from a client.
+* @param data The datagram, at least 3 bytes.
+* @param length Size of the datagram.
+* @param message Output structure, the views point into @p data.
+* @return true if the datagram was decoded.
+*/
+bool decodeDatagram(const char* data, size_t length, ClientMessage &message);
+
+/**
+* @brief Decodes one line of the TCP text grammar sent by a client.
+* @param line The line without CRLF.
+* @param message Output structure, the views point into @p line.
+* @return true if the line matches the grammar.
+*/
+bool decodeText(std::string_view line, ClientMessage &message);
+
+#endif /* CODEC_HPP */
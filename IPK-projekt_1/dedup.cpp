@@ -0,0 +1,52 @@
+#include "dedup.hpp"
+
+DuplicateWindow::DuplicateWindow() : highest(0), empty(true) {}
+
+bool DuplicateWindow::contains(uint16_t id) const {
+    if (empty) {
+        return false;
+    }
+    // Distance from the newest ID, negative for older IDs
+    int16_t distance = static_cast<int16_t>(id - highest);
+    if (distance > 0) {
+        return false;
+    }
+    if (-static_cast<int>(distance) >= WINDOW) {
+        return true;
+    }
+    return received[id % WINDOW];
+}
+
+void DuplicateWindow::insert(uint16_t id) {
+    if (empty) {
+        empty = false;
+        highest = id;
+        received[id % WINDOW] = true;
+        return;
+    }
+    int16_t distance = static_cast<int16_t>(id - highest);
+    if (distance > 0) {
+        // Slide the window, slots between the old and the new newest ID become free
+        if (distance >= WINDOW) {
+            received.reset();
+        } else {
+            for (uint16_t slot = highest + 1; slot != id; ++slot) {
+                received[slot % WINDOW] = false;
+            }
+        }
+        highest = id;
+    } else if (-static_cast<int>(distance) >= WINDOW) {
+        return;
+    }
+    received[id % WINDOW] = true;
+}
+
+size_t DuplicateWindow::size() const {
+    return received.count();
+}
+
+void DuplicateWindow::clear() {
+    received.reset();
+    highest = 0;
+    empty = true;
+}
@@ -0,0 +1,59 @@
+/**
+* @file dedup.hpp
+* @brief Header file for the DuplicateWindow class
+*/
+#ifndef DEDUP_HPP
+#define DEDUP_HPP
+
+#include <bitset>
+#include <cstdint>
+
+/**
+* @class DuplicateWindow
+* @brief Constant time and memory detection of duplicate message IDs
+*
+* Remembers the IDs of the last WINDOW messages received from the server in a
+* bitmap indexed by the low bits of the ID. IDs are compared with serial number
+* arithmetic on 16 bits, so the window keeps working after the ID wraps around.
+* An ID older than the window is reported as already seen.
+*/
+class DuplicateWindow {
+public:
+    static const int WINDOW = 4096; /**< Number of remembered IDs (power of two, at most half of the ID space) */
+
+    /**
+    * @brief Constructor for the DuplicateWindow class
+    */
+    DuplicateWindow();
+
+    /**
+    * @brief Checks if the ID was already received.
+    * @param id Message ID from the server.
+    * @return true if the ID is in the window or older than the window.
+    */
+    bool contains(uint16_t id) const;
+
+    /**
+    * @brief Records the ID as received, slides the window if the ID is newer than any before.
+    * @param id Message ID from the server.
+    */
+    void insert(uint16_t id);
+
+    /**
+    * @brief Forgets all received IDs.
+    */
+    void clear();
+
+    /**
+    * @brief Number of IDs remembered in the window.
+    * @return The count.
+    */
+    size_t size() const;
+
+private:
+    std::bitset<WINDOW> received; /**< Received flags indexed by id % WINDOW */
+    uint16_t highest; /**< Newest received ID */
+    bool empty; /**< No ID was received yet */
+};
+
+#endif /* DEDUP_HPP */
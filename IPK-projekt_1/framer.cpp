@@ -0,0 +1,50 @@
+#include "framer.hpp"
+#include "scan.hpp"
+#include <sys/socket.h>
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+Framer::Framer(size_t initialCapacity, size_t maxSize) : buffer(initialCapacity), head(0), tail(0), scanned(0), maxSize(maxSize) {}
+
+ssize_t Framer::readFrom(int sock){
+    // Reclaim consumed space, only the partial tail is moved
+    if (head > 0) {
+        if (tail > head) {
+            memmove(buffer.data(), buffer.data() + head, tail - head);
+        }
+        tail -= head;
+        scanned -= head;
+        head = 0;
+    }
+    if (tail == buffer.size()) {
+        if (buffer.size() >= maxSize) {
+            return -1;
+        }
+        buffer.resize(min(buffer.size() * 2, maxSize));
+    }
+    ssize_t bytesRead = recv(sock, buffer.data() + tail, buffer.size() - tail, 0);
+    if (bytesRead > 0) {
+        tail += bytesRead;
+    }
+    return bytesRead;
+}
+
+bool Framer::next(string_view &message){
+    const char* end = buffer.data() + tail;
+    const char* crlf = findCRLF(buffer.data() + max(scanned, head), end);
+    if (crlf != end) {
+        message = string_view(buffer.data() + head, crlf - (buffer.data() + head));
+        head = crlf + 2 - buffer.data();
+        scanned = head;
+        return true;
+    }
+    // Nothing complete, continue after the next read, a CR at the end may get its LF then
+    scanned = tail > head ? tail - 1 : head;
+    return false;
+}
+
+bool Framer::overflow() const {
+    return head == 0 && tail == buffer.size() && buffer.size() >= maxSize;
+}
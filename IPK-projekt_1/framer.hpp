@@ -0,0 +1,67 @@
+/**
+* @file framer.hpp
+* @brief Header file for the Framer class
+*/
+#ifndef FRAMER_HPP
+#define FRAMER_HPP
+
+#include <string_view>
+#include <vector>
+#include <sys/types.h>
+
+/**
+* @class Framer
+* @brief Reassembles CRLF terminated messages from a TCP byte stream
+*
+* TCP gives no guarantee that one recv returns exactly one message. The server
+* may coalesce several messages into one segment or split one message across
+* two segments. The framer collects received bytes in a growable buffer and
+* hands out every complete message as a view into that buffer, the partial
+* tail is kept for the next read.
+*/
+class Framer {
+private:
+    std::vector<char> buffer; /**< Receive buffer */
+    size_t head; /**< Start of the first unconsumed byte */
+    size_t tail; /**< End of the received data */
+    size_t scanned; /**< Position from which to continue searching for CRLF */
+    size_t maxSize; /**< Maximum size of one message including CRLF */
+public:
+    /**
+    * @brief Constructor for the Framer class
+    * @param initialCapacity Initial size of the receive buffer
+    * @param maxSize Maximum size of one message, buffer never grows past it
+    */
+    Framer(size_t initialCapacity = 4096, size_t maxSize = 65536);
+
+    /**
+    * @brief Receives available data from the socket into the buffer.
+    *
+    * Performs exactly one recv call. Before reading, the already consumed part of the
+    * buffer is reclaimed by moving the partial tail to the front, and if the buffer is
+    * still full it is doubled (up to maxSize).
+    *
+    * @param sock The socket to read from.
+    * @return Result of recv (number of bytes, 0 on closed connection, -1 on error).
+    */
+    ssize_t readFrom(int sock);
+
+    /**
+    * @brief Returns the next complete message.
+    *
+    * The returned view does not contain the terminating CRLF and stays valid
+    * until the next call of readFrom.
+    *
+    * @param message Output view of the message.
+    * @return true if a complete message was found, false otherwise.
+    */
+    bool next(std::string_view &message);
+
+    /**
+    * @brief Checks if the buffer is full and contains no CRLF.
+    * @return true if a message exceeds maxSize.
+    */
+    bool overflow() const;
+};
+
+#endif /* FRAMER_HPP */
@@ -0,0 +1,77 @@
+#include "histogram.hpp"
+
+using namespace std;
+
+int Histogram::bucketOf(uint64_t value){
+    // Position of the highest set bit, values below 2 * SUB_BUCKETS are exact
+    int highest = 63 - __builtin_clzll(value | 1);
+    int shift = highest > SUB_BUCKET_BITS ? highest - SUB_BUCKET_BITS : 0;
+    return shift * SUB_BUCKETS + static_cast<int>(value >> shift);
+}
+
+uint64_t Histogram::bucketEnd(int bucket){
+    if (bucket < 2 * SUB_BUCKETS) {
+        return bucket;
+    }
+    int shift = bucket / SUB_BUCKETS - 1;
+    uint64_t start = static_cast<uint64_t>(bucket - shift * SUB_BUCKETS) << shift;
+    return start + ((uint64_t(1) << shift) - 1);
+}
+
+void Histogram::record(uint64_t value){
+    buckets[bucketOf(value)].fetch_add(1, memory_order_relaxed);
+    total.fetch_add(1, memory_order_relaxed);
+    sum.fetch_add(value, memory_order_relaxed);
+    uint64_t current = maximum.load(memory_order_relaxed);
+    while (value > current && !maximum.compare_exchange_weak(current, value, memory_order_relaxed)) {
+    }
+}
+
+uint64_t Histogram::count() const {
+    return total.load(memory_order_relaxed);
+}
+
+uint64_t Histogram::max() const {
+    return maximum.load(memory_order_relaxed);
+}
+
+uint64_t Histogram::percentile(double fraction) const {
+    uint64_t values = count();
+    if (values == 0) {
+        return 0;
+    }
+    // Rank of the percentile counted from 1, nearest rank rounding
+    uint64_t rank = static_cast<uint64_t>(fraction * (values - 1) + 0.5) + 1;
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < BUCKETS; ++bucket) {
+        seen += buckets[bucket].load(memory_order_relaxed);
+        if (seen >= rank) {
+            // The bucket bound must not exceed the exact maximum
+            return min(bucketEnd(bucket), max());
+        }
+    }
+    return max();
+}
+
+void Histogram::printStats(ostream &out, const char* name, const char* unit) const {
+    uint64_t values = count();
+    out << name << ": " << values << " samples";
+    if (values > 0) {
+        out << ", mean " << static_cast<double>(sum.load(memory_order_relaxed)) / values << unit
+            << ", p50 " << percentile(0.5) << unit << ", p90 " << percentile(0.9) << unit
+            << ", p99 " << percentile(0.99) << unit << ", p999 " << percentile(0.999) << unit
+            << ", max " << max() << unit;
+    }
+    out << endl;
+}
+
+void MessageHistograms::recordSince(Histogram &histogram, chrono::steady_clock::time_point firstSent){
+    auto elapsed = chrono::duration_cast<Duration>(chrono::steady_clock::now() - firstSent);
+    histogram.record(elapsed.count() > 0 ? elapsed.count() : 0);
+}
+
+void MessageHistograms::printStats(ostream &out) const {
+    confirm.printStats(out, "time to first CONFIRM", " us");
+    reply.printStats(out, "time to REPLY", " us");
+    attempts.printStats(out, "attempts per message", "");
+}
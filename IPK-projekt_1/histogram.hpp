@@ -0,0 +1,113 @@
+/**
+* @file histogram.hpp
+* @brief Header file for the Histogram class and the per-message histograms
+*/
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+/**
+* @class Histogram
+* @brief Histogram of non-negative values with bounded relative error (HDR style)
+*
+* Values below 128 have their own bucket, every higher power of two is split into
+* 64 buckets, so a bucket is never wider than 1/64 of its values. The buckets are
+* a fixed array covering the whole uint64_t range, nothing is allocated after
+* construction.
+*
+* record is a few relaxed atomic additions, so any number of threads may record
+* into one histogram and a reader may print it at any time. A printed snapshot is
+* not atomic as a whole, it may miss the samples recorded while it is read.
+*/
+class Histogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 6; /**< log2 of the number of buckets per power of two */
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS; /**< Buckets per power of two */
+    static constexpr int BUCKETS = (63 - SUB_BUCKET_BITS) * SUB_BUCKETS + 2 * SUB_BUCKETS; /**< Number of buckets */
+
+    /**
+    * @brief Adds a value.
+    * @param value The value.
+    */
+    void record(uint64_t value);
+
+    /**
+    * @brief Number of recorded values.
+    * @return The count.
+    */
+    uint64_t count() const;
+
+    /**
+    * @brief Value below which the given fraction of values lies.
+    * @param fraction Fraction between 0 and 1, e.g. 0.99 for p99.
+    * @return Upper bound of the bucket holding the percentile, zero if there are no values.
+    */
+    uint64_t percentile(double fraction) const;
+
+    /**
+    * @brief Largest recorded value (exact).
+    * @return The maximum, zero if there are no values.
+    */
+    uint64_t max() const;
+
+    /**
+    * @brief Writes the count, mean, p50, p90, p99, p999 and the maximum.
+    * @param out Output stream.
+    * @param name Name of the measured quantity.
+    * @param unit Unit printed after each value, empty for plain numbers.
+    */
+    void printStats(std::ostream &out, const char* name, const char* unit) const;
+
+    /**
+    * @brief Bucket of a value.
+    * @param value The value.
+    * @return Index into the buckets.
+    */
+    static int bucketOf(uint64_t value);
+
+    /**
+    * @brief Largest value of a bucket.
+    * @param bucket Index of the bucket.
+    * @return The value.
+    */
+    static uint64_t bucketEnd(int bucket);
+
+private:
+    std::atomic<uint64_t> buckets[BUCKETS] = {}; /**< Number of values in each bucket */
+    std::atomic<uint64_t> total{0}; /**< Number of values */
+    std::atomic<uint64_t> sum{0}; /**< Sum of the values for the mean */
+    std::atomic<uint64_t> maximum{0}; /**< Largest value */
+};
+
+/**
+* @brief Latencies and attempts of the messages sent to the server
+*
+* One set is shared by every session that records into it. Latencies are measured
+* from the first transmission of a message, retransmissions do not restart them.
+*/
+struct MessageHistograms {
+    typedef std::chrono::microseconds Duration;
+
+    Histogram confirm; /**< First transmission to the first CONFIRM in microseconds (UDP) */
+    Histogram reply; /**< First transmission of AUTH or JOIN to its REPLY in microseconds */
+    Histogram attempts; /**< Transmissions of a message until it was confirmed, replied or given up (UDP) */
+
+    /**
+    * @brief Records the time from the first transmission to now.
+    * @param histogram confirm or reply.
+    * @param firstSent Time of the first transmission.
+    */
+    static void recordSince(Histogram &histogram, std::chrono::steady_clock::time_point firstSent);
+
+    /**
+    * @brief Writes all three histograms.
+    * @param out Output stream.
+    */
+    void printStats(std::ostream &out) const;
+};
+
+#endif /* HISTOGRAM_HPP */
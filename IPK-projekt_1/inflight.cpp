@@ -0,0 +1,56 @@
+#include "inflight.hpp"
+
+InflightTable::InflightTable(BufferPool &pool) : pool(pool), slots(SLOTS), count(0), statusCounts() {
+    for (MessageInfo &slot : slots) {
+        slot.status = FREE;
+        slot.content = nullptr;
+    }
+}
+
+MessageInfo* InflightTable::find(uint16_t messageID) {
+    MessageInfo &slot = slots[messageID % SLOTS];
+    if (slot.status == FREE || slot.messageID != messageID) {
+        return nullptr;
+    }
+    return &slot;
+}
+
+MessageInfo* InflightTable::add(uint16_t messageID) {
+    MessageInfo &slot = slots[messageID % SLOTS];
+    if (slot.status != FREE) {
+        return nullptr;
+    }
+    slot.messageID = messageID;
+    slot.status = SENT;
+    ++statusCounts[SENT];
+    ++count;
+    return &slot;
+}
+
+void InflightTable::retire(MessageInfo* message) {
+    if (message->status != FREE) {
+        --statusCounts[message->status];
+        message->status = FREE;
+        pool.release(message->content);
+        message->content = nullptr;
+        --count;
+    }
+}
+
+void InflightTable::setStatus(MessageInfo* message, MessageStatus status) {
+    --statusCounts[message->status];
+    message->status = status;
+    ++statusCounts[status];
+}
+
+size_t InflightTable::countOf(MessageStatus status) const {
+    return statusCounts[status];
+}
+
+size_t InflightTable::size() const {
+    return count;
+}
+
+bool InflightTable::empty() const {
+    return count == 0;
+}
@@ -0,0 +1,108 @@
+/**
+* @file inflight.hpp
+* @brief Header file for the InflightTable class
+*/
+#ifndef INFLIGHT_HPP
+#define INFLIGHT_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include "pool.hpp"
+
+/**
+* @brief State of a sent message
+*/
+enum MessageStatus {
+    FREE,      /**< Slot is not used */
+    SENT,      /**< Sent, waiting for CONFIRM (retransmitted on timeout) */
+    CONFIRMED  /**< Confirmed, waiting for REPLY */
+};
+
+/**
+* @brief Structure representing information about a message
+*/
+struct MessageInfo {
+    int retries; /**< Number of retries for the message */
+    int messageID; /**< ID of the message */
+    PacketBuffer* content; /**< Encoded message, owned by the table until the message is retired */
+    std::chrono::steady_clock::time_point timer; /**< Timer for the message */
+    std::chrono::steady_clock::time_point firstSent; /**< Time of the first transmission, kept by retransmissions */
+    std::chrono::steady_clock::time_point deadline; /**< Time of the next retransmission */
+    MessageStatus status; /**< State of the message */
+    bool awaitsReply; /**< The server answers the message with REPLY (AUTH and JOIN) */
+};
+
+/**
+* @class InflightTable
+* @brief Sent messages that are not finished yet, indexed by MessageID
+*
+* The slot of a message is given by the low bits of its ID. IDs are assigned
+* sequentially, so two live messages share a slot only when more than SLOTS
+* messages are in flight. Lookup, insert and retire are O(1) and nothing is
+* ever shifted.
+*/
+class InflightTable {
+public:
+    static const int SLOTS = 1024; /**< Number of slots (power of two) */
+
+    /**
+    * @brief Constructor for the InflightTable class
+    * @param pool Pool the buffers of retired messages are returned to
+    */
+    InflightTable(BufferPool &pool);
+
+    /**
+    * @brief Finds the unfinished message with the given ID.
+    * @param messageID ID of the message.
+    * @return Pointer to the message or nullptr if there is none.
+    */
+    MessageInfo* find(uint16_t messageID);
+
+    /**
+    * @brief Occupies the slot for a new message.
+    * @param messageID ID of the message.
+    * @return Pointer to the message with status SENT, nullptr if the slot is used by another message.
+    */
+    MessageInfo* add(uint16_t messageID);
+
+    /**
+    * @brief Changes the state of a message.
+    * @param message Message returned by find or add.
+    * @param status New state (use retire for FREE).
+    */
+    void setStatus(MessageInfo* message, MessageStatus status);
+
+    /**
+    * @brief Number of messages in the given state.
+    * @param status State of the message.
+    * @return Count of messages.
+    */
+    size_t countOf(MessageStatus status) const;
+
+    /**
+    * @brief Releases the slot of a finished message and returns its buffer to the pool.
+    * @param message Message returned by find or add.
+    */
+    void retire(MessageInfo* message);
+
+    /**
+    * @brief Number of unfinished messages.
+    * @return Count of used slots.
+    */
+    size_t size() const;
+
+    /**
+    * @brief Checks if there are no unfinished messages.
+    * @return true if no slot is used.
+    */
+    bool empty() const;
+
+private:
+    BufferPool &pool; /**< Pool of message buffers */
+    std::vector<MessageInfo> slots; /**< Messages indexed by messageID % SLOTS */
+    size_t count; /**< Number of used slots */
+    size_t statusCounts[CONFIRMED + 1]; /**< Number of slots in each state */
+};
+
+#endif /* INFLIGHT_HPP */
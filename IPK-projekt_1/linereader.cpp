@@ -0,0 +1,153 @@
+#include "linereader.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+LineReader::LineReader(size_t capacity) : buffer(max(capacity, MAX_LINE + 1)) {}
+
+ssize_t LineReader::readFrom(int fd){
+    // Reclaim consumed space, only the partial tail is moved
+    if (head > 0) {
+        if (tail > head) {
+            memmove(buffer.data(), buffer.data() + head, tail - head);
+        }
+        tail -= head;
+        scanned -= head;
+        head = 0;
+    }
+    // A partial line is never longer than MAX_LINE, so only complete lines fill the buffer
+    if (tail == buffer.size()) {
+        errno = EAGAIN;
+        return -1;
+    }
+    ssize_t bytesRead = read(fd, buffer.data() + tail, buffer.size() - tail);
+    if (bytesRead > 0) {
+        tail += bytesRead;
+    } else if (bytesRead == 0) {
+        closed = true;
+    }
+    return bytesRead;
+}
+
+bool LineReader::next(string_view &line){
+    cut = false;
+    while (head < tail) {
+        const char* lf = static_cast<const char*>(memchr(buffer.data() + scanned, '\n', tail - scanned));
+        size_t end = lf != nullptr ? lf - buffer.data() : tail;
+        if (skipping) {
+            // The rest of a line already handed out cut
+            head = lf != nullptr ? end + 1 : tail;
+            scanned = head;
+            skipping = lf == nullptr;
+            continue;
+        }
+        if (end - head > MAX_LINE) {
+            line = string_view(buffer.data() + head, MAX_LINE);
+            cut = true;
+            head = lf != nullptr ? end + 1 : tail;
+            scanned = head;
+            skipping = lf == nullptr;
+            return true;
+        }
+        if (lf == nullptr) {
+            scanned = tail;
+            if (!closed) {
+                return false;
+            }
+            // The last line of the input has no newline
+            line = string_view(buffer.data() + head, tail - head);
+            head = tail;
+            scanned = tail;
+            return true;
+        }
+        line = string_view(buffer.data() + head, end - head);
+        head = end + 1;
+        scanned = head;
+        return true;
+    }
+    return false;
+}
+
+bool LineReader::overlong() const {
+    return cut;
+}
+
+bool LineReader::finished() const {
+    return closed && head == tail;
+}
+
+ScriptFile::~ScriptFile(){
+    if (data != nullptr) {
+        munmap(const_cast<char*>(data), size);
+    }
+}
+
+bool ScriptFile::open(const string &path){
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0) {
+        close(fd);
+        return false;
+    }
+    size = info.st_size;
+    if (size > 0) {
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        // The file is read once from start to end
+        madvise(mapped, size, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(mapped);
+    }
+    close(fd);
+    return true;
+}
+
+bool ScriptFile::next(string_view &line){
+    if (pos >= size) {
+        return false;
+    }
+    const char* lf = static_cast<const char*>(memchr(data + pos, '\n', size - pos));
+    size_t end = lf != nullptr ? lf - data : size;
+    line = string_view(data + pos, end - pos);
+    pos = end + 1;
+    return true;
+}
+
+bool ScriptFile::finished() const {
+    return pos >= size;
+}
+
+TokenBucket::TokenBucket(double rate, double capacity)
+    : rate(rate), capacity(max(capacity, 1.0)), tokens(max(capacity, 1.0)), refilled(Clock::now()) {}
+
+bool TokenBucket::ready(Clock::time_point now){
+    double elapsed = chrono::duration<double>(now - refilled).count();
+    tokens = min(capacity, tokens + elapsed * rate);
+    refilled = now;
+    return tokens >= 1;
+}
+
+void TokenBucket::consume(){
+    tokens -= 1;
+}
+
+int TokenBucket::timeout(Clock::time_point now) const {
+    double elapsed = chrono::duration<double>(now - refilled).count();
+    double missing = 1 - (tokens + elapsed * rate);
+    if (missing <= 0) {
+        return 0;
+    }
+    return static_cast<int>(ceil(missing / rate * 1000));
+}
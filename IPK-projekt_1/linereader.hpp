@@ -0,0 +1,170 @@
+/**
+* @file linereader.hpp
+* @brief Header file for the LineReader and ScriptFile classes
+*/
+#ifndef LINEREADER_HPP
+#define LINEREADER_HPP
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/types.h>
+#include "validate.hpp"
+
+/**
+* @class LineReader
+* @brief Splits the user input read from stdin into lines
+*
+* Replaces getline on cin, whose buffer may hold lines the event loop does not
+* know about. One readFrom is one read of everything that fits into the buffer,
+* called only when the descriptor is readable, so it never blocks. All complete
+* lines are then handed out by next as views into the buffer, the partial tail
+* waits for the next read. At the end of input the tail is the last line, as
+* with getline.
+*
+* The buffer does not grow. A line longer than MAX_LINE cannot be valid, it is
+* handed out cut to MAX_LINE characters and marked by overlong, the rest of it
+* is skipped up to the newline without being buffered.
+*/
+class LineReader {
+public:
+    /** Longest line handed out whole, a message of the longest content and room for a command and a CR */
+    static constexpr size_t MAX_LINE = CONTENT_RULE.maxLength + 128;
+
+    /**
+    * @brief Constructor for the LineReader class
+    * @param capacity Size of the buffer, at least MAX_LINE + 1.
+    */
+    LineReader(size_t capacity = 65536);
+
+    /**
+    * @brief Reads available data from the descriptor into the buffer.
+    *
+    * Performs at most one read call, the consumed part of the buffer is reclaimed
+    * first. Nothing is read while the buffer is full of lines not handed out yet.
+    *
+    * @param fd The descriptor to read from.
+    * @return Result of read (number of bytes, 0 at the end of input, -1 on error),
+    *         -1 with errno EAGAIN if the buffer is full.
+    */
+    ssize_t readFrom(int fd);
+
+    /**
+    * @brief Returns the next complete line.
+    *
+    * The view does not contain the newline and stays valid until the next readFrom.
+    *
+    * @param line Output view of the line.
+    * @return true if a line was found.
+    */
+    bool next(std::string_view &line);
+
+    /**
+    * @brief Checks if the last line from next was cut.
+    * @return true if the line was longer than MAX_LINE.
+    */
+    bool overlong() const;
+
+    /**
+    * @brief Checks if the input ended and every line was handed out.
+    * @return true if nothing more will come.
+    */
+    bool finished() const;
+
+private:
+    std::vector<char> buffer; /**< Read buffer */
+    size_t head = 0; /**< Start of the first line not handed out */
+    size_t tail = 0; /**< End of the read data */
+    size_t scanned = 0; /**< Position from which to continue searching for the newline */
+    bool closed = false; /**< read returned the end of input */
+    bool cut = false; /**< The last line handed out was cut to MAX_LINE */
+    bool skipping = false; /**< The rest of a cut line is dropped up to its newline */
+};
+
+/**
+* @class ScriptFile
+* @brief User lines of a script file mapped into memory (--script)
+*
+* The file is mapped read-only and walked sequentially, every line is a view
+* into the mapping, nothing is copied.
+*/
+class ScriptFile {
+public:
+    /**
+    * @brief Destructor for the ScriptFile class, unmaps the file
+    */
+    ~ScriptFile();
+
+    /**
+    * @brief Maps the file.
+    * @param path Path of the script.
+    * @return false if the file cannot be opened or mapped.
+    */
+    bool open(const std::string &path);
+
+    /**
+    * @brief Returns the next line, the last one may lack the newline.
+    * @param line Output view of the line, valid while the file is mapped.
+    * @return true if a line was found.
+    */
+    bool next(std::string_view &line);
+
+    /**
+    * @brief Checks if every line was handed out.
+    * @return true at the end of the file.
+    */
+    bool finished() const;
+
+private:
+    const char* data = nullptr; /**< Mapped file */
+    size_t size = 0; /**< Size of the file */
+    size_t pos = 0; /**< Start of the next line */
+};
+
+/**
+* @class TokenBucket
+* @brief Paces the script lines to a target rate
+*
+* Tokens are added at the given rate up to the capacity, every line takes one.
+* The capacity allows a short burst after a pause, so the average rate holds
+* even though the event loop wakes up with a millisecond granularity.
+*/
+class TokenBucket {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+    * @brief Constructor for the TokenBucket class, starts full
+    * @param rate Tokens per second.
+    * @param capacity Maximum number of stored tokens (at least 1).
+    */
+    TokenBucket(double rate, double capacity);
+
+    /**
+    * @brief Adds the tokens earned since the last call and checks if one is available.
+    * @param now Current time.
+    * @return true if a line may be sent.
+    */
+    bool ready(Clock::time_point now);
+
+    /**
+    * @brief Takes one token, call only after ready returned true.
+    */
+    void consume();
+
+    /**
+    * @brief Time until the next token.
+    * @param now Current time.
+    * @return Milliseconds, 0 if a token is available.
+    */
+    int timeout(Clock::time_point now) const;
+
+private:
+    double rate; /**< Tokens per second */
+    double capacity; /**< Maximum number of tokens */
+    double tokens; /**< Available tokens */
+    Clock::time_point refilled; /**< Time of the last refill */
+};
+
+#endif /* LINEREADER_HPP */
@@ -0,0 +1,580 @@
+/**
+* @file loadgen.cpp
+* @brief Load generator running many IPK24-CHAT sessions against one server
+*
+* The sessions use the TCP and UDP classes of the client, only stdin is replaced
+* by a script: every session authorizes, joins a channel, sends MSGs at a fixed
+* rate and says BYE. The sessions are split between worker threads, each thread
+* runs its share in one Reactor.
+*/
+#include <iostream>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <string.h>
+#include <netdb.h>
+#include <getopt.h>
+#include <csignal>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include "tcp.hpp"
+#include "udp.hpp"
+#include "reactor.hpp"
+#include "histogram.hpp"
+#include "metrics.hpp"
+#include "options.hpp"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// A session whose AUTH or JOIN is not answered in this time fails, UDP has no REPLY timer of its own
+static constexpr int REPLY_TIMEOUT_MS = TCP::REPLY_TIMEOUT_MS;
+
+/**
+* @brief Parameters of the generated load
+*/
+struct LoadConfig {
+    bool udp = false; /**< UDP instead of TCP */
+    struct sockaddr_in serverAddr; /**< Server address */
+    int sessions = 100; /**< Number of sessions */
+    int threads = 4; /**< Number of worker threads */
+    int messages = 100; /**< MSGs sent by every session */
+    int rate = 10; /**< MSGs per second of every session */
+    string channel = "loadtest"; /**< Channel joined by every session */
+    int d = 250; /**< Initial UDP retransmission timeout in milliseconds */
+    int r = 3; /**< UDP retries */
+    int w = 16; /**< UDP send window */
+    MessageHistograms* histograms = nullptr; /**< Latencies and attempts, shared by the sessions of all workers */
+    Histogram* replyLatency = nullptr; /**< Time from AUTH or JOIN to its REPLY in microseconds, shared like histograms */
+    Histogram* confirmLatency = nullptr; /**< UDP CONFIRM round trip times in microseconds, shared like histograms */
+};
+
+/**
+* @brief Progress of one session through the script
+*/
+enum Phase {
+    PHASE_AUTH,    /**< Waiting for the REPLY to AUTH */
+    PHASE_JOIN,    /**< Waiting for the REPLY to JOIN */
+    PHASE_SEND,    /**< Sending MSGs */
+    PHASE_CLOSING, /**< UDP BYE waits for its CONFIRM */
+    PHASE_DONE     /**< Finished */
+};
+
+/**
+* @brief One session driven by a worker
+*/
+struct LoadSession {
+    int sock = -1; /**< Socket of the session */
+    TCP* tcp = nullptr; /**< TCP transport, nullptr for UDP */
+    UDP* udp = nullptr; /**< UDP transport, nullptr for TCP */
+    Phase phase = PHASE_AUTH; /**< Position in the script */
+    string name; /**< Username and display name */
+    Clock::time_point replyStart; /**< When the AUTH or JOIN was sent */
+    Clock::time_point nextSend; /**< When the next MSG is due */
+    int sent = 0; /**< MSGs sent so far */
+    bool failed = false; /**< The session did not finish the script */
+};
+
+/**
+* @brief Results of one worker, merged by main
+*/
+struct WorkerStats {
+    long completed = 0; /**< Sessions that finished the script */
+    long failed = 0; /**< Sessions that did not */
+    long messages = 0; /**< MSGs sent */
+    long retransmissions = 0; /**< UDP retransmissions */
+};
+
+/**
+* @class Worker
+* @brief Runs a share of the sessions in one thread
+*/
+class Worker {
+public:
+    /**
+    * @brief Constructor for the Worker class
+    * @param config Parameters of the load.
+    * @param first Index of the first session, used in the names.
+    * @param count Number of sessions.
+    * @param stats Results of the worker.
+    */
+    Worker(const LoadConfig &config, int first, int count, WorkerStats &stats)
+        : config(config), first(first), count(count), stats(stats) {}
+
+    /**
+    * @brief Opens the sessions and runs them until all are finished.
+    */
+    void run();
+
+private:
+    /**
+    * @brief Session of the transport used by s.
+    */
+    const Session& sessionOf(const LoadSession &s) const {
+        return s.tcp != nullptr ? s.tcp->session : s.udp->session;
+    }
+
+    /**
+    * @brief Passes a scripted line to the session as if the user typed it.
+    */
+    void userLine(LoadSession &s, string_view line);
+
+    /**
+    * @brief Moves the session through the script after its state changed.
+    */
+    void advance(LoadSession &s);
+
+    /**
+    * @brief Sends due MSGs and handles transport deadlines of all sessions.
+    */
+    void tick();
+
+    /**
+    * @brief Time until the nearest deadline of any session.
+    * @return Milliseconds, -1 if there is none.
+    */
+    int nextTimeout();
+
+    /**
+    * @brief Ends the script of the session.
+    * @param failed The session did not get to the end of the script.
+    */
+    void finish(LoadSession &s, bool failed);
+
+    /**
+    * @brief Releases the transport of a finished session.
+    */
+    void release(LoadSession &s);
+
+    /**
+    * @brief Creates the socket and the transport of a session.
+    * @return false if the socket could not be created or connected.
+    */
+    bool open(LoadSession &s, int index);
+
+    const LoadConfig &config; /**< Parameters of the load */
+    int first; /**< Index of the first session of this worker */
+    int count; /**< Number of sessions of this worker */
+    WorkerStats &stats; /**< Results of this worker */
+    Reactor reactor; /**< Event loop of this worker */
+    vector<LoadSession> sessions; /**< Sessions of this worker */
+    int active = 0; /**< Sessions that are not finished */
+};
+
+bool Worker::open(LoadSession &s, int index) {
+    s.name = "load" + to_string(index);
+    if (config.udp) {
+        if ((s.sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+            cerr << "UDP socket creation error" << endl;
+            return false;
+        }
+        s.udp = new UDP();
+        s.udp->r = config.r;
+        s.udp->d = config.d;
+        s.udp->rtt.reset(config.d);
+        s.udp->window = config.w;
+        s.udp->sockClose = s.sock;
+        s.udp->serverAddr = config.serverAddr;
+        s.udp->quiet = true;
+        s.udp->confirmLatency = config.confirmLatency;
+        s.udp->histograms = config.histograms;
+    } else {
+        if ((s.sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+            cerr << "TCP socket creation error" << endl;
+            return false;
+        }
+        if (connect(s.sock, (struct sockaddr *)&config.serverAddr, sizeof(config.serverAddr)) < 0) {
+            cerr << "Connection Failed" << endl;
+            close(s.sock);
+            return false;
+        }
+        s.tcp = new TCP();
+        s.tcp->sockClose = s.sock;
+        s.tcp->quiet = true;
+        s.tcp->histograms = config.histograms;
+    }
+    return true;
+}
+
+void Worker::run() {
+    sessions.resize(count);
+    for (int i = 0; i < count; ++i) {
+        LoadSession &s = sessions[i];
+        if (!open(s, first + i)) {
+            s.phase = PHASE_DONE;
+            ++stats.failed;
+            continue;
+        }
+        ++active;
+        int sock = s.sock;
+        if (s.udp != nullptr) {
+            reactor.add(s.udp->receiver.watchFd(sock), EPOLLIN, [this, &s, sock](uint32_t) {
+                s.udp->beginBatch();
+                int received;
+                do {
+                    received = s.udp->receiver.drain(sock);
+                    for (int j = 0; j < received; ++j) {
+                        s.udp->receive(s.udp->receiver.data(j), s.udp->receiver.length(j), sock);
+                    }
+                } while (received == DatagramReceiver::BATCH);
+                s.udp->endBatch(sock);
+                s.udp->fillWindow(sock);
+                if (received < 0) {
+                    finish(s, true);
+                    return;
+                }
+                advance(s);
+            });
+        } else {
+            reactor.add(sock, EPOLLIN, [this, &s, sock](uint32_t) {
+                if (s.tcp->framer.readFrom(sock) <= 0) {
+                    finish(s, true);
+                    return;
+                }
+                string_view message;
+                while (s.tcp->framer.next(message) && s.tcp->session.state() != END) {
+                    if (!message.empty()) {
+                        s.tcp->receive(message, sock);
+                    }
+                }
+                advance(s);
+            });
+        }
+        s.replyStart = Clock::now();
+        userLine(s, "/auth " + s.name + " secret " + s.name);
+    }
+
+    reactor.onTimer([this]() { tick(); });
+    reactor.onPrepare([this]() {
+        if (active == 0) {
+            reactor.stop();
+        }
+        return nextTimeout();
+    });
+    // Sessions left unfinished by a failed reactor count as failed
+    bool ok = active == 0 || reactor.run();
+    if (!ok) {
+        cerr << reactor.failure() << endl;
+    }
+    for (LoadSession &s : sessions) {
+        if (s.phase != PHASE_DONE) {
+            s.failed = s.failed || !ok;
+            release(s);
+        }
+    }
+}
+
+void Worker::userLine(LoadSession &s, string_view line) {
+    if (s.tcp != nullptr) {
+        s.tcp->perform(s.tcp->session.userLine(line), s.sock);
+    } else {
+        s.udp->perform(s.udp->session.userLine(line), s.sock);
+    }
+}
+
+void Worker::advance(LoadSession &s) {
+    const Session &session = sessionOf(s);
+    switch (s.phase) {
+    case PHASE_AUTH:
+        if (session.state() == OPEN) {
+            auto now = Clock::now();
+            config.replyLatency->record(chrono::duration_cast<chrono::microseconds>(now - s.replyStart).count());
+            s.replyStart = now;
+            s.phase = PHASE_JOIN;
+            userLine(s, "/join " + config.channel);
+        } else if (session.state() != AUTH) {
+            // Refused or ended by the server
+            finish(s, true);
+        }
+        break;
+    case PHASE_JOIN:
+        if (session.state() != OPEN) {
+            finish(s, true);
+        } else if (session.pendingReplies() == 0) {
+            auto now = Clock::now();
+            config.replyLatency->record(chrono::duration_cast<chrono::microseconds>(now - s.replyStart).count());
+            s.phase = PHASE_SEND;
+            s.nextSend = now;
+            if (config.messages == 0) {
+                finish(s, false);
+            }
+        }
+        break;
+    case PHASE_SEND:
+        if (session.state() != OPEN) {
+            finish(s, true);
+        }
+        break;
+    case PHASE_CLOSING:
+        if (s.udp->sessionClosed()) {
+            release(s);
+        }
+        break;
+    case PHASE_DONE:
+        break;
+    }
+}
+
+void Worker::tick() {
+    auto now = Clock::now();
+    auto interval = chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / config.rate));
+    for (LoadSession &s : sessions) {
+        if (s.phase == PHASE_DONE) {
+            continue;
+        }
+        if ((s.phase == PHASE_AUTH || s.phase == PHASE_JOIN) && now - s.replyStart >= chrono::milliseconds(REPLY_TIMEOUT_MS)) {
+            finish(s, true);
+            continue;
+        }
+        if (s.phase == PHASE_SEND) {
+            // A late tick sends every MSG that is due, the rate is kept on average
+            while (s.nextSend <= now && s.sent < config.messages) {
+                userLine(s, "message " + to_string(s.sent) + " from " + s.name);
+                ++s.sent;
+                ++stats.messages;
+                s.nextSend += interval;
+            }
+            if (s.sent == config.messages) {
+                finish(s, false);
+                continue;
+            }
+        }
+        if (s.tcp != nullptr) {
+            s.tcp->processTimeout(s.sock);
+            advance(s);
+        } else {
+            s.udp->beginBatch();
+            bool delivered = s.udp->processTimers(s.sock);
+            s.udp->endBatch(s.sock);
+            if (!delivered) {
+                s.failed = true;
+                release(s);
+                continue;
+            }
+            s.udp->fillWindow(s.sock);
+            advance(s);
+        }
+    }
+}
+
+int Worker::nextTimeout() {
+    auto now = Clock::now();
+    int timeout = -1;
+    for (const LoadSession &s : sessions) {
+        if (s.phase == PHASE_DONE) {
+            continue;
+        }
+        int next = s.tcp != nullptr ? s.tcp->nextTimeout() : s.udp->nextTimeout();
+        Clock::time_point deadline;
+        if (s.phase == PHASE_SEND) {
+            deadline = s.nextSend;
+        } else if (s.phase == PHASE_AUTH || s.phase == PHASE_JOIN) {
+            deadline = s.replyStart + chrono::milliseconds(REPLY_TIMEOUT_MS);
+        }
+        if (s.phase != PHASE_CLOSING) {
+            auto remaining = chrono::duration_cast<chrono::milliseconds>(deadline - now).count();
+            int due = remaining > 0 ? static_cast<int>(remaining) : 0;
+            next = next < 0 ? due : min(next, due);
+        }
+        if (next >= 0 && (timeout < 0 || next < timeout)) {
+            timeout = next;
+        }
+    }
+    return timeout;
+}
+
+void Worker::finish(LoadSession &s, bool failed) {
+    if (s.phase == PHASE_CLOSING || s.phase == PHASE_DONE) {
+        return;
+    }
+    s.failed = failed;
+    if (sessionOf(s).state() != END) {
+        // An empty line ends the session with BYE
+        userLine(s, "");
+    }
+    if (s.udp != nullptr && !s.udp->sessionClosed()) {
+        s.phase = PHASE_CLOSING;
+        return;
+    }
+    release(s);
+}
+
+void Worker::release(LoadSession &s) {
+    if (s.phase == PHASE_DONE) {
+        return;
+    }
+    if (s.tcp != nullptr) {
+        reactor.remove(s.sock);
+        delete s.tcp; // sends BYE and closes the socket
+        s.tcp = nullptr;
+    } else {
+        reactor.remove(s.udp->receiver.watchFd(s.sock));
+        stats.retransmissions += s.udp->retransmissions;
+        delete s.udp; // closes the socket
+        s.udp = nullptr;
+    }
+    s.phase = PHASE_DONE;
+    if (s.failed) {
+        ++stats.failed;
+    } else {
+        ++stats.completed;
+    }
+    --active;
+}
+
+int main(int argc, char *argv[])
+{
+    LoadConfig config;
+    string transportProtocol;
+    string serverAddress;
+    uint16_t port = 4567;
+    string metricsPath;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:s:p:c:T:n:f:j:d:r:w:m:h")) != -1) {
+        switch (opt) {
+            case 't':
+                transportProtocol = optarg;
+                break;
+            case 's':
+                serverAddress = optarg;
+                break;
+            case 'p':
+                port = static_cast<uint16_t>(numberOption(optarg, 0, UINT16_MAX, "port number"));
+                break;
+            case 'c':
+                config.sessions = numberOption(optarg, 1, 100000, "number of sessions");
+                break;
+            case 'T':
+                config.threads = numberOption(optarg, 1, 256, "number of threads");
+                break;
+            case 'n':
+                config.messages = numberOption(optarg, 0, 1000000, "number of messages");
+                break;
+            case 'f':
+                config.rate = numberOption(optarg, 1, 1000000, "message rate");
+                break;
+            case 'j':
+                config.channel = optarg;
+                break;
+            case 'd':
+                config.d = numberOption(optarg, 0, UINT16_MAX, "time number");
+                break;
+            case 'r':
+                config.r = numberOption(optarg, 0, UINT8_MAX, "retries number");
+                break;
+            case 'w':
+                config.w = numberOption(optarg, 1, InflightTable::SLOTS, "window size");
+                break;
+            case 'm':
+                metricsPath = optarg;
+                break;
+            case 'h':
+                cout << "Usage: ./ipk24chat-loadgen -t [tcp/udp] -s [server address] [options]" << endl;
+                cout << endl;
+                cout << "Every session authorizes, joins a channel, sends messages at a fixed rate and says BYE." << endl;
+                cout << "   - `-p port`: port number (uint16, default value 4567)" << endl;
+                cout << "   - `-c sessions`: number of concurrent sessions (default value 100)" << endl;
+                cout << "   - `-T threads`: number of worker threads (default value 4)" << endl;
+                cout << "   - `-n messages`: messages sent by every session (default value 100)" << endl;
+                cout << "   - `-f rate`: messages per second of every session (default value 10)" << endl;
+                cout << "   - `-j channel`: channel to join (default value loadtest)" << endl;
+                cout << "   - `-d timer`, `-r retries`, `-w window`: UDP parameters as in ipk24chat-client" << endl;
+                cout << "   - `-m path`: serve metrics of all sessions in the Prometheus text format on a Unix socket" << endl;
+                cout << "   - `-h`: help" << endl;
+                exit(0);
+            default:
+                cerr << "For help use -h" << endl;
+                exit(-1);
+        }
+    }
+
+    if ((transportProtocol != "tcp" && transportProtocol != "udp") || serverAddress.empty()) {
+        cerr << "For help use -h" << endl;
+        return -1;
+    }
+    config.udp = transportProtocol == "udp";
+
+    struct hostent *server = gethostbyname(serverAddress.c_str());
+    if (server == NULL) {
+        cerr << "Hostname resolution failed" << endl;
+        return -1;
+    }
+    bzero((char *)&config.serverAddr, sizeof(config.serverAddr));
+    config.serverAddr.sin_family = AF_INET;
+    bcopy((char *)server->h_addr, (char *)&config.serverAddr.sin_addr.s_addr, server->h_length);
+    config.serverAddr.sin_port = htons(port);
+
+    // A server closing the connection must not kill the whole run
+    signal(SIGPIPE, SIG_IGN);
+
+
+    config.threads = min(config.threads, config.sessions);
+    MessageHistograms histograms;
+    config.histograms = &histograms;
+    Histogram replyLatency;
+    config.replyLatency = &replyLatency;
+    Histogram confirmLatency;
+    config.confirmLatency = &confirmLatency;
+    vector<WorkerStats> stats(config.threads);
+    vector<thread> workers;
+    atomic<int> running(config.threads);
+    auto start = Clock::now();
+    int first = 0;
+    for (int i = 0; i < config.threads; ++i) {
+        int count = config.sessions / config.threads + (i < config.sessions % config.threads ? 1 : 0);
+        workers.emplace_back([&config, &stats, &running, i, first, count]() {
+            Worker worker(config, first, count, stats[i]);
+            worker.run();
+            --running;
+        });
+        first += count;
+    }
+    // The main thread serves the metrics summed over the workers until they finish
+    if (!metricsPath.empty()) {
+        Reactor reactor;
+        MetricsServer metrics;
+        if (!metrics.open(metricsPath, reactor)) {
+            cerr << "Cannot create metrics socket " << metricsPath << ": " << metrics.failure() << endl;
+        }
+        reactor.onPrepare([&]() {
+            if (running == 0) {
+                reactor.stop();
+            }
+            return 100;
+        });
+        // The workers go on without the metrics
+        if (!reactor.run()) {
+            cerr << "Metrics are not served: " << reactor.failure() << endl;
+        }
+    }
+    for (thread &worker : workers) {
+        worker.join();
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    WorkerStats total;
+    for (WorkerStats &worker : stats) {
+        total.completed += worker.completed;
+        total.failed += worker.failed;
+        total.messages += worker.messages;
+        total.retransmissions += worker.retransmissions;
+    }
+    cout << "sessions: " << total.completed << " completed, " << total.failed << " failed" << endl;
+    cout << "messages: " << total.messages << " in " << seconds << " s, " << total.messages / seconds << " msg/s" << endl;
+    replyLatency.printStats(cout, "reply latency", " us");
+    if (config.udp) {
+        confirmLatency.printStats(cout, "confirm latency", " us");
+        cout << "retransmissions: " << total.retransmissions << endl;
+        // Unlike the confirm latency above, these include the retransmitted messages
+        histograms.confirm.printStats(cout, "time to first CONFIRM", " us");
+        histograms.attempts.printStats(cout, "attempts per message", "");
+    }
+    return total.failed == 0 ? 0 : 1;
+}
@@ -8,48 +8,166 @@
 #include <getopt.h>
 #include <algorithm> 
 #include <atomic>    
-#include <poll.h>
-#include <regex>
 #include <csignal>
 #include <cstdlib>
 #include <functional>
+#include <string_view>
+#include <chrono>
+#include <cmath>
+#include <cerrno>
 #include "tcp.hpp"
 #include "udp.hpp"
+#include "reactor.hpp"
+#include "metrics.hpp"
+#include "linereader.hpp"
+#include "output.hpp"
 
 using namespace std;
 
 // Global pointer to an instance of the UDP class
 UDP* clientUDP = nullptr;
 TCP* clientTCP = nullptr;
+// Print statistics before exit (-v)
+bool statsRequested = false;
+// Latencies and attempts of the sent messages, printed on SIGUSR1 and with -v at exit
+MessageHistograms histograms;
+// User lines from stdin, or from the script file (--script) instead
+LineReader stdinLines;
+ScriptFile script;
+bool scripted = false;
+// Paces the script lines (--rate), unless paced they go as fast as the session accepts them
+TokenBucket pacer(1, 1);
+bool paced = false;
+// Script lines passed to the session and the times of the first and the last one
+size_t scriptLines = 0;
+chrono::steady_clock::time_point firstScriptLine, lastScriptLine;
+
+// Passes the buffered user lines to the session while it accepts them
+template <typename Client>
+void deliverLines(Client &client, int sock) {
+    string_view line;
+    while (client.session.state() != END && client.acceptsInput()) {
+        auto now = chrono::steady_clock::now();
+        // The end of the script does not wait for a token
+        if (paced && !script.finished() && !pacer.ready(now)) {
+            return;
+        }
+        if (!(scripted ? script.next(line) : stdinLines.next(line))) {
+            if (scripted ? script.finished() : stdinLines.finished()) {
+                if (!scripted) {
+                    standardOutput().writeLine({"EOF detected on stdin"});
+                }
+                client.endOfInput(sock);
+            }
+            return;
+        }
+        // Only stdin lines are cut, a longer line cannot be valid anyway
+        if (!scripted && stdinLines.overlong()) {
+            standardError().writeLine({"ERR: Line too long, it was not sent."});
+            continue;
+        }
+        if (paced) {
+            pacer.consume();
+        }
+        if (scripted) {
+            if (scriptLines++ == 0) {
+                firstScriptLine = now;
+            }
+            lastScriptLine = now;
+        }
+        client.sendingFromClient(sock, line);
+    }
+}
 
-// Function to handle the SIGINT signal
-void signalHandler(int signum) {
-    cout << "Caught signal " << signum << endl;
+// Time until the pacer allows the next script line, -1 if the loop does not wait for it
+int pacerTimeout(bool acceptsInput) {
+    if (!paced || !acceptsInput || script.finished()) {
+        return -1;
+    }
+    return pacer.timeout(chrono::steady_clock::now());
+}
 
-    if (clientUDP != nullptr) {
-        delete clientUDP;
+// Earlier of two poll timeouts, -1 means none
+int earlierTimeout(int a, int b) {
+    if (a < 0) {
+        return b;
     }
-    if (clientTCP != nullptr){
-        delete clientTCP;
+    return b < 0 ? a : min(a, b);
+}
+
+// Reads what stdin holds, a read error ends the input like its end
+bool readUserInput() {
+    if (stdinLines.readFrom(STDIN_FILENO) < 0 && errno != EINTR && errno != EAGAIN) {
+        standardError().writeLine({"ERR: cannot read stdin"});
+        return false;
     }
+    return true;
+}
 
-    exit(signum);
+// Writes the lines buffered in this loop iteration, or hands them to the writer threads
+void flushOutput() {
+    standardOutput().flush();
+    standardError().flush();
 }
 
-void cleanupAndExitUDP(int sock) {
-    if (clientUDP != nullptr) {
-        delete clientUDP;
+// Writes the rest of the output, the reports after the loop included, and stops the writer threads
+void finishOutput() {
+    standardOutput().finish();
+    standardError().finish();
+}
+
+// Passes what print writes into a stream to the stderr sink, in order with the session output
+template <typename Print>
+void writeReport(Print print) {
+    ostringstream out;
+    print(out);
+    string report = out.str();
+    if (!report.empty() && report.back() == '\n') {
+        report.pop_back();
+    }
+    if (!report.empty()) {
+        standardError().writeLine({report});
     }
-    //close(sock);
-    exit(0);
 }
 
-void cleanupAndExitTCP(int sock) {
-    if (clientTCP != nullptr) {
-        delete clientTCP;
+// Throughput of the script and the time until the session was over
+void printScriptReport(ostream &out) {
+    if (scriptLines == 0) {
+        out << "Script: no lines sent" << endl;
+        return;
+    }
+    double sending = chrono::duration<double>(lastScriptLine - firstScriptLine).count();
+    double total = chrono::duration<double>(chrono::steady_clock::now() - firstScriptLine).count();
+    out << "Script: " << scriptLines << " lines sent in " << sending << " s";
+    if (sending > 0) {
+        out << " (" << scriptLines / sending << " lines/s)";
+    }
+    out << ", session finished after " << total << " s" << endl;
+}
+
+// Passes every complete message buffered by the framer to the session
+void processMessagesTCP(int sock) {
+    string_view message;
+    while (clientTCP->framer.next(message)) {
+        bool hasNonWhitespace = false;
+        for (char c : message)
+        {
+            if (!isspace(static_cast<unsigned char>(c)))
+            {
+                hasNonWhitespace = true;
+                break;
+            }
+        }
+
+        if (hasNonWhitespace)
+        {
+            clientTCP->receive(message, sock);
+            if (clientTCP->session.state() == END)
+            {
+                return;
+            }
+        }
     }
-    //close(sock);
-    exit(0);
 }
 
 int main(int argc, char *argv[])
@@ -64,8 +182,21 @@ int main(int argc, char *argv[])
     bool retTime = false;
     int d = 250; // milliseconds
     int r = 3;
-
-    while ((opt = getopt(argc, argv, "t:s:d:r:p:h")) != -1) {
+    int w = 16;
+    string metricsPath;
+    string scriptPath;
+    double rate = 0; // script lines per second, 0 for no pacing
+    bool writerThread = false;
+    OverloadPolicy overload = OVERLOAD_BLOCK;
+
+    static const struct option longOptions[] = {
+        {"script", required_argument, nullptr, 'S'},
+        {"rate", required_argument, nullptr, 'R'},
+        {"writer-thread", no_argument, nullptr, 'O'},
+        {"overload", required_argument, nullptr, 'L'},
+        {nullptr, 0, nullptr, 0}
+    };
+    while ((opt = getopt_long(argc, argv, "t:s:d:r:w:p:m:vh", longOptions, nullptr)) != -1) {
         int parsedPort; // Define variable here
         switch (opt) {
             case 't':
@@ -118,6 +249,48 @@ int main(int argc, char *argv[])
                 r = static_cast<uint8_t>(parsedPort);
                 retTime = true;
                 break;
+            case 'w':
+                for (size_t i = 0; optarg[i] != '\0'; ++i) {
+                    if (!isdigit(optarg[i])) {
+                        cerr << "Invalid parameter: " << optarg << ". Please provide a valid numerical value." << endl;
+                        exit(-1);
+                    }
+                }
+                parsedPort = atoi(optarg);
+                if (parsedPort < 1 || parsedPort > InflightTable::SLOTS) {
+                    cerr << "Invalid window size. Please provide a value from 1 to " << InflightTable::SLOTS << "." << endl;
+                    exit(-1);
+                }
+                w = parsedPort;
+                retTime = true;
+                break;
+            case 'm':
+                metricsPath = optarg;
+                break;
+            case 'S':
+                scriptPath = optarg;
+                break;
+            case 'R': {
+                char* end;
+                rate = strtod(optarg, &end);
+                if (*end != '\0' || !(rate > 0) || !isfinite(rate)) {
+                    cerr << "Invalid rate: " << optarg << ". Please provide a positive number of lines per second." << endl;
+                    exit(-1);
+                }
+                break;
+            }
+            case 'O':
+                writerThread = true;
+                break;
+            case 'L':
+                if (!parseOverloadPolicy(optarg, overload)) {
+                    cerr << "Invalid overload policy: " << optarg << ". Please provide block, drop or summarize." << endl;
+                    exit(-1);
+                }
+                break;
+            case 'v':
+                statsRequested = true;
+                break;
             case 'h':
                 helpRequested = true;
                 break;
@@ -136,9 +309,17 @@ int main(int argc, char *argv[])
         cout << endl;
         cout << "   Additional optional parameters:" << endl;
         cout << "     - `-p port`: port number (uint16, default value 4567)" << endl;
-        cout << "     - `-d timer`: timer (uint16, default value 250 ms)" << endl;
+        cout << "     - `-d timer`: initial timer, adapted to the measured round trip time up to 4x this value (uint16, default value 250 ms)" << endl;
         cout << "     - `-r retries`: number of retries (uint8, default value 3)" << endl;
+        cout << "     - `-w window`: maximum number of unconfirmed messages (1-1024, default value 16)" << endl;
+        cout << "     - `-v`: print receive statistics and message latency histograms on exit" << endl;
+        cout << "     - `-m path`: serve metrics in the Prometheus text format on a Unix socket" << endl;
+        cout << "     - `--script file`: send the lines of file instead of reading stdin, report the throughput" << endl;
+        cout << "     - `--rate lines`: script lines per second (default as fast as the session accepts them)" << endl;
+        cout << "     - `--writer-thread`: write stdout and stderr on dedicated threads, a slow reader does not stall the client" << endl;
+        cout << "     - `--overload policy`: block, drop or summarize the oldest lines when the reader falls behind (default block, the others imply --writer-thread)" << endl;
         cout << "     - `-h`: help" << endl;
+        cout << "   SIGUSR1 prints the message latency histograms to stderr at any time." << endl;
         cout << endl;
         cout << "Running TCP:" << endl;
         cout << "   ./ipk24chat-client -t tcp -s serverAddress" << endl;
@@ -146,8 +327,13 @@ int main(int argc, char *argv[])
         cout << endl;
         cout << "   Additional optional parameters:" << endl;
         cout << "     - `-p port`: port number (uint16, default value 4567)" << endl;
+        cout << "     - `-v`: print REPLY latency histogram on exit" << endl;
+        cout << "     - `-m path`: serve metrics in the Prometheus text format on a Unix socket" << endl;
+        cout << "     - `--script file`: send the lines of file instead of reading stdin, report the throughput" << endl;
+        cout << "     - `--rate lines`: script lines per second (default as fast as the session accepts them)" << endl;
+        cout << "     - `--writer-thread`: write stdout and stderr on dedicated threads, a slow reader does not stall the client" << endl;
+        cout << "     - `--overload policy`: block, drop or summarize the oldest lines when the reader falls behind (default block, the others imply --writer-thread)" << endl;
         cout << "     - `-h`: help" << endl;
-        cout << "     - you cannot use another parameter with tcp protocol" << endl;
         exit(0);
     }
 
@@ -157,11 +343,38 @@ int main(int argc, char *argv[])
         return -1;
     }
 
+    if (!scriptPath.empty()) {
+        if (!script.open(scriptPath)) {
+            cerr << "Cannot open script " << scriptPath << endl;
+            return -1;
+        }
+        scripted = true;
+    }
+    if (rate > 0) {
+        if (!scripted) {
+            cerr << "--rate can only be used with --script" << endl;
+            return -1;
+        }
+        // A hundredth of a second of lines, the loop wakes up with a millisecond granularity
+        pacer = TokenBucket(rate, rate / 100);
+        paced = true;
+    }
+    // Only a writer thread can fall behind, without it every write completes in the loop
+    if (overload != OVERLOAD_BLOCK) {
+        writerThread = true;
+    }
+    standardOutput().setPolicy(overload);
+    standardError().setPolicy(overload);
+    if (writerThread) {
+        standardOutput().startWriter();
+        standardError().startWriter();
+    }
+
     // Create socket
     int sock = 0;
     if (transportProtocol == "tcp") {
         if(retTime){
-            cerr << "cannot combinate -d or -r with tcp" << endl;
+            cerr << "cannot combinate -d, -r or -w with tcp" << endl;
             return -1;
         }
         if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0)
@@ -185,13 +398,6 @@ int main(int argc, char *argv[])
         }
     }
 
-    struct pollfd fds[2]; // for sock and for stdin
-    fds[0].fd = sock;
-    fds[0].events = POLLIN;
-
-    fds[1].fd = STDIN_FILENO; // stdin
-    fds[1].events = POLLIN;
-
     // Hostname to IP address
     struct hostent *server;
     server = gethostbyname(serverAddress.c_str());
@@ -201,8 +407,24 @@ int main(int argc, char *argv[])
         return -1;
     }
 
-
-    signal(SIGINT, signalHandler);
+    // Sockets, stdin, deadlines and SIGINT are all handled by one event loop
+    Reactor reactor;
+    int exitCode = 0;
+
+    // Counters scraped from a local socket (-m), served by the event loop
+    MetricsServer metrics;
+    // Time in the current state is accounted before every scrape
+    auto refreshState = [&]() {
+        if (clientTCP != nullptr) {
+            clientTCP->stateClock.flush(clientTCP->session.state());
+        } else if (clientUDP != nullptr) {
+            clientUDP->stateClock.flush(clientUDP->session.state());
+        }
+    };
+    if (!metricsPath.empty() && !metrics.open(metricsPath, reactor, refreshState)) {
+        cerr << "Cannot create metrics socket " << metricsPath << ": " << metrics.failure() << endl;
+        return -1;
+    }
 
     // Connect to server
     if (transportProtocol == "tcp") {  
@@ -214,157 +436,204 @@ int main(int argc, char *argv[])
         serv_addr.sin_port = htons(port);
                 
         clientTCP = new TCP();    
+        clientTCP->histograms = &histograms;
         if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0)
         {
             cerr << "Connection Failed" << endl;
-            //cleanupAndExitTCP(sock);
             return -1;
         }
         clientTCP->sockClose = sock;
-        cout << "Authorize yourself, please. If you're unsure how, type /help." << endl;
-        clientTCP->startCommunication(sock, clientTCP->username, clientTCP->secret, clientTCP->displayName);
+        standardOutput().writeLine({"Authorize yourself, please. If you're unsure how, type /help."});
 
-        clientTCP->currentState = clientTCP->nextState(clientTCP->currentState, "", sock);
-
-        if(clientTCP->currentState == END){
-            cleanupAndExitTCP(sock);
-        }
-        while (true)
-        {
-            int ret = poll(fds, 2, -1); // unlimit timeout
-            if (ret == -1)
+        reactor.add(sock, EPOLLIN, [&](uint32_t) {
+            ssize_t bytesRead = clientTCP->framer.readFrom(sock);
+            if (bytesRead <= 0)
             {
-                cerr << "poll() failed" << endl;
-                cleanupAndExitTCP(sock);
-            }
-
-            if (fds[0].revents & POLLIN){
-                char buffer[1500];
-                ssize_t bytesRead = recv(sock, buffer, sizeof(buffer), 0);
-                if (bytesRead <= 0)
-                {
-                    cerr << "Connection closed by server" << endl;
-                    cleanupAndExitTCP(sock);
-                }
-
-                bool hasNonWhitespace = false;
-                for (int i = 0; i < bytesRead; ++i)
-                {
-                    if (!isspace(buffer[i]))
-                    {
-                        hasNonWhitespace = true;
-                        break;
-                    }
-                }
-
-                if (hasNonWhitespace)
-                {
-                    clientTCP->currentState = clientTCP->nextState(clientTCP->currentState, buffer, sock);
-                    if (clientTCP->currentState == END)
-                    {
-                        cleanupAndExitTCP(sock);
-                    }
+                if (clientTCP->framer.overflow()) {
+                    standardError().writeLine({"ERR: message from server is too long"});
+                } else {
+                    standardError().writeLine({"Connection closed by server"});
                 }
+                reactor.stop();
+                return;
             }
-
-            if (fds[1].revents & POLLHUP) {
-                cout << "EOF detected on stdin" << endl;
-                cleanupAndExitTCP(sock);
+            processMessagesTCP(sock);
+            if (clientTCP->session.state() == END) {
+                reactor.stop();
             }
-            
-            // receive from clientTCP
-            if (fds[1].revents & POLLIN)
-            {   
-                clientTCP->sendingFromClient(sock, clientTCP->username, clientTCP->displayName);
-                if(clientTCP->currentState == END){
-                    cleanupAndExitTCP(sock);
-                }
+        });
+        // The lines read are passed to the session by prepare
+        Reactor::Handler readStdin = [&](uint32_t) {
+            if (!readUserInput()) {
+                reactor.stop();
+            }
+        };
+        reactor.onTimer([&]() {
+            clientTCP->processTimeout(sock);
+            if (clientTCP->session.state() == END) {
+                reactor.stop();
+            }
+        });
+        reactor.onPrepare([&]() {
+            // Every complete line goes out in this iteration, unless a REPLY is pending
+            deliverLines(*clientTCP, sock);
+            if (clientTCP->session.state() == END) {
+                reactor.stop();
+                return -1;
+            }
+            // stdin is not read while a REPLY is pending, it stays buffered
+            if (scripted || !clientTCP->acceptsInput()) {
+                reactor.remove(STDIN_FILENO);
+            } else if (!reactor.watching(STDIN_FILENO)) {
+                reactor.add(STDIN_FILENO, EPOLLIN, readStdin);
             }
+            // The lines printed in this iteration go out before the loop waits
+            flushOutput();
+            // unlimited unless a REPLY is pending or the script is paced
+            return earlierTimeout(clientTCP->nextTimeout(), pacerTimeout(clientTCP->acceptsInput()));
+        });
+        reactor.onSignal(SIGINT, [&]() {
+            standardOutput().writeLine({"Caught signal ", to_string(SIGINT)});
+            exitCode = SIGINT;
+            reactor.stop();
+        });
+        reactor.onSignal(SIGUSR1, [&]() {
+            writeReport([&](ostream &out) { histograms.printStats(out); });
+        });
+        // A failed onSignal is reported by run as well
+        if (!reactor.run()) {
+            standardError().writeLine({reactor.failure()});
+            exitCode = -1;
         }
+        if (scripted) {
+            writeReport(printScriptReport);
+        }
+        if (statsRequested) {
+            writeReport([&](ostream &out) {
+                histograms.printStats(out);
+                standardOutput().printStats(out, "stdout");
+                standardError().printStats(out, "stderr");
+            });
+        }
+        delete clientTCP;
+        finishOutput();
+        return exitCode;
     }
     else if (transportProtocol == "udp") {
         clientUDP = new UDP();
         clientUDP->r = r; // retries
         clientUDP->d = d;
+        clientUDP->rtt.reset(d);
+        clientUDP->window = w;
+        clientUDP->histograms = &histograms;
         clientUDP->sockClose = sock;
         clientUDP->setServerAddress(serverAddress, port);
-        cout << "Authorize yourself, please. If you're unsure how, type /help." << endl;
-        clientUDP->startCommunication(sock, clientUDP->username, clientUDP->secret, clientUDP->displayName);
-
-        if(clientUDP->currentState == END){
-            cleanupAndExitUDP(sock);
-        }
-        // Receive response from the server
-        while(true){
-            int ret = poll(fds, 2, 1000);
-            if (ret == -1)
-            {
-                cerr << "poll() failed" << endl;
-                cleanupAndExitUDP(sock);
-            }
-
-            if (fds[0].revents & POLLIN){
-                char responseBuffer[1500];
-                struct sockaddr_in serverResponseAddr;
-                socklen_t serverResponseLen = sizeof(serverResponseAddr);
-
-                ssize_t responseBytesReceived = recvfrom(sock, responseBuffer, sizeof(responseBuffer), 0, (struct sockaddr *)&serverResponseAddr, &serverResponseLen);
-                if (responseBytesReceived < 0) {
-                    cerr << "Error in receiving response from server" << endl;
-                    cleanupAndExitUDP(sock);
+        standardOutput().writeLine({"Authorize yourself, please. If you're unsure how, type /help."});
+
+        // Every way out of the session ends with the BYE, the loop runs until it is confirmed
+        auto closeSession = [&]() {
+            reactor.remove(STDIN_FILENO);
+            clientUDP->closeSession(sock);
+        };
+        // The socket itself, or the io_uring completing receives on it (make IO_URING=1)
+        reactor.add(clientUDP->receiver.watchFd(sock), EPOLLIN, [&](uint32_t) {
+            // CONFIRMs and retransmissions of this pass go out together at its end
+            clientUDP->beginBatch();
+            // Drain everything the socket holds, a full batch means more may be waiting
+            int received;
+            do {
+                received = clientUDP->receiver.drain(sock);
+                if (received < 0) {
+                    standardError().writeLine({"Error in receiving response from server"});
+                    clientUDP->endBatch(sock);
+                    reactor.stop();
+                    return;
                 }
-
-                responseBuffer[responseBytesReceived] = '\0';
-
-                clientUDP->currentState = clientUDP->nextState(clientUDP->currentState, responseBuffer, sock);
-                if(clientUDP->currentState == END){
-                    cleanupAndExitUDP(sock);
+                for (int i = 0; i < received; ++i) {
+                    clientUDP->receive(clientUDP->receiver.data(i), clientUDP->receiver.length(i), sock);
+                    if (clientUDP->session.state() == END) {
+                        closeSession();
+                    }
                 }
+            } while (received == DatagramReceiver::BATCH);
+            // Retransmissions due by now join the CONFIRMs in the same sendmmsg
+            bool delivered = clientUDP->processTimers(sock);
+            clientUDP->endBatch(sock);
+            if (!delivered) {
+                reactor.stop();
+                return;
             }
-            
-            // If revents is set to POLLHUP, it means stdin was closed by the client
-            if (fds[1].revents & POLLHUP) {
-                cout << "EOF detected on stdin" << endl;
-                cleanupAndExitUDP(sock);
+            // Confirmed and replied messages made room for the waiting ones
+            clientUDP->fillWindow(sock);
+        });
+        // The lines read are passed to the session by prepare
+        Reactor::Handler readStdin = [&](uint32_t) {
+            if (!readUserInput()) {
+                closeSession();
             }
-            
-            if (fds[1].revents & POLLIN){
-                clientUDP->sendingFromClient(sock, clientUDP->username, clientUDP->displayName);
-                if(clientUDP->currentState == END){
-                    cleanupAndExitUDP(sock);
-                }
+        };
+        reactor.onTimer([&]() {
+            clientUDP->beginBatch();
+            bool delivered = clientUDP->processTimers(sock);
+            clientUDP->endBatch(sock);
+            if (!delivered) {
+                reactor.stop();
+                return;
             }
-            for (auto it = clientUDP->sentMessages.begin(); it != clientUDP->sentMessages.end(); ) {
-                auto& msg = *it;
-
-                auto currentTime = std::chrono::steady_clock::now();
-                auto timeDiff = std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - msg.timer);
-
-                // Wait for a certain time (500 milliseconds)
-                if (timeDiff.count() > d) {
-                    // Check if `retries` for the current message is not zero
-                    if (msg.retries > 0) {
-                        // Check if confirm is true
-                        if (!msg.confirm) {
-                            //cout << "Message with messageID " << msg.messageID << " has not been acknowledged for more than 5 seconds." << endl;
-                            clientUDP->sendAgain(sock, msg.content);
-                            msg.retries--; // Decrement one retry
-                            msg.timer = std::chrono::steady_clock::now(); // Set timer to current time
-                        } else {
-                            // If confirm is true, skip this message
-                            ++it;
-                            continue;
-                        }
-                    }
-                    else {
-                        // If the number of retries is 0, remove the message from the vector
-                        it = clientUDP->sentMessages.erase(it);
-                        cleanupAndExitUDP(sock);
-                    }
-                }
-                ++it;
+            clientUDP->fillWindow(sock);
+        });
+        reactor.onPrepare([&]() {
+            // Every complete line goes out in this iteration, as far as the window allows
+            deliverLines(*clientUDP, sock);
+            if (clientUDP->sessionClosed()) {
+                reactor.stop();
+            }
+            // stdin is not read while the REPLY to AUTH is pending, while the window is
+            // full, nor after closeSession
+            if (scripted || !clientUDP->acceptsInput()) {
+                reactor.remove(STDIN_FILENO);
+            } else if (!reactor.watching(STDIN_FILENO)) {
+                reactor.add(STDIN_FILENO, EPOLLIN, readStdin);
             }
+            flushOutput();
+            return earlierTimeout(clientUDP->nextTimeout(), pacerTimeout(clientUDP->acceptsInput()));
+        });
+        // SIGINT closes the session the same way, a second one stops right away
+        reactor.onSignal(SIGINT, [&]() {
+            standardOutput().writeLine({"Caught signal ", to_string(SIGINT)});
+            exitCode = SIGINT;
+            if (clientUDP->byeSent) {
+                reactor.stop();
+            }
+            closeSession();
+        });
+        reactor.onSignal(SIGUSR1, [&]() {
+            writeReport([&](ostream &out) { histograms.printStats(out); });
+        });
+
+        // A failed onSignal is reported by run as well
+        if (!reactor.run()) {
+            standardError().writeLine({reactor.failure()});
+            exitCode = -1;
         }
+
+        if (scripted) {
+            writeReport(printScriptReport);
+        }
+        if (statsRequested) {
+            writeReport([&](ostream &out) {
+                clientUDP->receiver.printStats(out);
+                clientUDP->sender.printStats(out);
+                clientUDP->rtt.printStats(out);
+                histograms.printStats(out);
+                standardOutput().printStats(out, "stdout");
+                standardError().printStats(out, "stderr");
+            });
+        }
+        // The final BYE of the destructor may still report an error
+        delete clientUDP;
+        finishOutput();
+        return exitCode;
     }
     close(sock);
 
@@ -0,0 +1,253 @@
+#include "metrics.hpp"
+#include "output.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+using namespace std;
+
+/**
+* @brief Description of one metric for formatMetrics
+*/
+struct MetricInfo {
+    const char* name; /**< Prometheus name */
+    const char* type; /**< counter or gauge */
+    const char* help; /**< HELP text */
+    Counter ThreadMetrics::* field; /**< Counter in ThreadMetrics */
+};
+
+static const MetricInfo metricInfos[] = {
+    {"ipk24chat_received_bytes_total", "counter", "Bytes of messages from the server.", &ThreadMetrics::bytesReceived},
+    {"ipk24chat_sent_bytes_total", "counter", "Bytes sent to the server, including CONFIRMs and retransmissions.", &ThreadMetrics::bytesSent},
+    {"ipk24chat_received_messages_total", "counter", "Messages from the server, including CONFIRMs and duplicates.", &ThreadMetrics::messagesReceived},
+    {"ipk24chat_sent_messages_total", "counter", "Messages sent to the server, including CONFIRMs and retransmissions.", &ThreadMetrics::messagesSent},
+    {"ipk24chat_retransmissions_total", "counter", "Retransmitted UDP messages.", &ThreadMetrics::retransmissions},
+    {"ipk24chat_expired_messages_total", "counter", "UDP messages not confirmed after all retries.", &ThreadMetrics::expired},
+    {"ipk24chat_duplicates_dropped_total", "counter", "UDP messages from the server dropped as duplicates.", &ThreadMetrics::duplicates},
+    {"ipk24chat_unmatched_replies_total", "counter", "UDP REPLYs dropped because they do not answer the AUTH or JOIN waiting for REPLY.", &ThreadMetrics::unmatchedReplies},
+    {"ipk24chat_inflight_messages", "gauge", "Sent UDP messages not confirmed or replied yet.", &ThreadMetrics::inflight},
+    {"ipk24chat_server_ids_remembered", "gauge", "Message IDs from the server remembered for deduplication.", &ThreadMetrics::serverIDs},
+};
+static const int METRIC_COUNT = sizeof(metricInfos) / sizeof(metricInfos[0]);
+
+static const char* stateNames[STATE_COUNT] = {"start", "auth", "open", "end", "error"};
+
+// Instances of the running threads and the sums of the exited ones
+static mutex registryMutex;
+static vector<ThreadMetrics*> registry;
+static uint64_t exitedValues[METRIC_COUNT];
+static uint64_t exitedStates[STATE_COUNT];
+
+ThreadMetrics::ThreadMetrics(){
+    lock_guard<mutex> lock(registryMutex);
+    registry.push_back(this);
+}
+
+ThreadMetrics::~ThreadMetrics(){
+    lock_guard<mutex> lock(registryMutex);
+    for (int i = 0; i < METRIC_COUNT; ++i) {
+        exitedValues[i] += (this->*metricInfos[i].field).get();
+    }
+    for (int i = 0; i < STATE_COUNT; ++i) {
+        exitedStates[i] += stateMicroseconds[i].get();
+    }
+    registry.erase(find(registry.begin(), registry.end(), this));
+}
+
+ThreadMetrics& threadMetrics(){
+    thread_local ThreadMetrics metrics;
+    return metrics;
+}
+
+// Counters of the stdout and stderr sinks, labeled by the stream
+static void formatOutputMetrics(string &out){
+    OutputStats streams[2] = {standardOutput().stats(), standardError().stats()};
+    const char* streamNames[2] = {"stdout", "stderr"};
+    static const struct {
+        const char* name;
+        const char* help;
+        uint64_t OutputStats::* field;
+    } outputInfos[] = {
+        {"ipk24chat_output_lines_total", "Lines printed to the user, including dropped ones.", &OutputStats::lines},
+        {"ipk24chat_output_writes_total", "writev calls writing the printed lines.", &OutputStats::writes},
+        {"ipk24chat_output_dropped_lines_total", "Lines dropped by the overload policy.", &OutputStats::dropped},
+        {"ipk24chat_output_summaries_total", "Summaries of dropped lines printed by the summarize policy.", &OutputStats::summaries},
+        {"ipk24chat_output_blocked_total", "Times the client waited for the writer thread (block policy).", &OutputStats::blocked},
+    };
+    for (const auto &info : outputInfos) {
+        out.append("# HELP ").append(info.name).append(" ").append(info.help).append("\n");
+        out.append("# TYPE ").append(info.name).append(" counter\n");
+        for (int i = 0; i < 2; ++i) {
+            out.append(info.name).append("{stream=\"").append(streamNames[i]).append("\"} ").append(to_string(streams[i].*info.field)).append("\n");
+        }
+    }
+    out.append("# HELP ipk24chat_output_blocked_seconds_total Time the client waited for the writer thread.\n");
+    out.append("# TYPE ipk24chat_output_blocked_seconds_total counter\n");
+    for (int i = 0; i < 2; ++i) {
+        char seconds[32];
+        snprintf(seconds, sizeof(seconds), "%.6f", streams[i].blockedMicroseconds / 1e6);
+        out.append("ipk24chat_output_blocked_seconds_total{stream=\"").append(streamNames[i]).append("\"} ").append(seconds).append("\n");
+    }
+    out.append("# HELP ipk24chat_output_policy Overload policy of the stream, the active one has the value 1.\n");
+    out.append("# TYPE ipk24chat_output_policy gauge\n");
+    for (int i = 0; i < 2; ++i) {
+        for (int policy = OVERLOAD_BLOCK; policy <= OVERLOAD_SUMMARIZE; ++policy) {
+            out.append("ipk24chat_output_policy{stream=\"").append(streamNames[i]).append("\",policy=\"")
+                .append(overloadPolicyName(static_cast<OverloadPolicy>(policy))).append("\"} ")
+                .append(streams[i].policy == policy ? "1" : "0").append("\n");
+        }
+    }
+}
+
+void formatMetrics(string &out){
+    uint64_t values[METRIC_COUNT];
+    uint64_t states[STATE_COUNT];
+    {
+        lock_guard<mutex> lock(registryMutex);
+        copy(exitedValues, exitedValues + METRIC_COUNT, values);
+        copy(exitedStates, exitedStates + STATE_COUNT, states);
+        for (const ThreadMetrics* metrics : registry) {
+            for (int i = 0; i < METRIC_COUNT; ++i) {
+                values[i] += (metrics->*metricInfos[i].field).get();
+            }
+            for (int i = 0; i < STATE_COUNT; ++i) {
+                states[i] += metrics->stateMicroseconds[i].get();
+            }
+        }
+    }
+    out.clear();
+    for (int i = 0; i < METRIC_COUNT; ++i) {
+        const MetricInfo &info = metricInfos[i];
+        out.append("# HELP ").append(info.name).append(" ").append(info.help).append("\n");
+        out.append("# TYPE ").append(info.name).append(" ").append(info.type).append("\n");
+        // Gauges are sums of increments and decrements, possibly from different threads
+        string value = info.type[0] == 'g' ? to_string(static_cast<int64_t>(values[i])) : to_string(values[i]);
+        out.append(info.name).append(" ").append(value).append("\n");
+    }
+    out.append("# HELP ipk24chat_state_seconds_total Time spent by the sessions in each state.\n");
+    out.append("# TYPE ipk24chat_state_seconds_total counter\n");
+    for (int i = 0; i < STATE_COUNT; ++i) {
+        char seconds[32];
+        snprintf(seconds, sizeof(seconds), "%.6f", states[i] / 1e6);
+        out.append("ipk24chat_state_seconds_total{state=\"").append(stateNames[i]).append("\"} ").append(seconds).append("\n");
+    }
+    formatOutputMetrics(out);
+}
+
+StateClock::StateClock(ThreadMetrics &metrics) : metrics(metrics), state(START), since(chrono::steady_clock::now()) {}
+
+void StateClock::flush(State current){
+    auto now = chrono::steady_clock::now();
+    metrics.stateMicroseconds[state].add(chrono::duration_cast<chrono::microseconds>(now - since).count());
+    state = current;
+    since = now;
+}
+
+MetricsServer::~MetricsServer(){
+    if (listenFd != -1) {
+        reactor->remove(listenFd);
+        close(listenFd);
+        // The path may have been replaced since, only our own socket is removed
+        struct stat info;
+        if (lstat(socketPath.c_str(), &info) == 0 && info.st_dev == boundDevice && info.st_ino == boundInode) {
+            unlink(socketPath.c_str());
+        }
+    }
+}
+
+// Checks if a listening socket answers at address, errno tells why not
+static bool socketAnswers(const struct sockaddr_un &address) {
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (probe < 0) {
+        return true;
+    }
+    int result = connect(probe, reinterpret_cast<const struct sockaddr*>(&address), sizeof(address));
+    int error = errno;
+    close(probe);
+    errno = error;
+    return result == 0;
+}
+
+bool MetricsServer::open(const string &path, Reactor &reactor, function<void()> refresh){
+    struct sockaddr_un address = {};
+    if (path.size() >= sizeof(address.sun_path)) {
+        failureReason = "path too long";
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    // Only a socket left behind by a previous run is replaced, any other file is kept
+    struct stat info;
+    if (lstat(path.c_str(), &info) == 0) {
+        if (!S_ISSOCK(info.st_mode)) {
+            failureReason = "not a socket";
+            return false;
+        }
+        // A live endpoint accepts (or has a full backlog), a stale one refuses
+        if (socketAnswers(address) || errno != ECONNREFUSED) {
+            failureReason = "in use";
+            return false;
+        }
+        unlink(path.c_str());
+    }
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        failureReason = strerror(errno);
+        return false;
+    }
+    if (bind(listenFd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0 || listen(listenFd, 16) < 0
+        || lstat(path.c_str(), &info) < 0) {
+        failureReason = strerror(errno);
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    boundDevice = info.st_dev;
+    boundInode = info.st_ino;
+    socketPath = path;
+    this->reactor = &reactor;
+    this->refresh = refresh;
+    reactor.add(listenFd, EPOLLIN, [this](uint32_t) { acceptClients(); });
+    return true;
+}
+
+const char* MetricsServer::failure() const {
+    return failureReason;
+}
+
+void MetricsServer::acceptClients(){
+    while (true) {
+        int client = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        reactor->add(client, EPOLLIN, [this, client](uint32_t) { respond(client); });
+    }
+}
+
+void MetricsServer::respond(int client){
+    // The request itself does not matter, every path gets the metrics
+    char request[1024];
+    while (recv(client, request, sizeof(request), 0) == sizeof(request)) {
+    }
+    if (refresh) {
+        refresh();
+    }
+    formatMetrics(body);
+    response.assign("HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: ")
+        .append(to_string(body.size())).append("\r\n\r\n").append(body);
+    // The response is far below the socket buffer, a client that does not read loses the rest
+    send(client, response.data(), response.size(), MSG_NOSIGNAL);
+    reactor->remove(client);
+    close(client);
+}
@@ -0,0 +1,199 @@
+/**
+* @file metrics.hpp
+* @brief Header file for the per-thread counters and the MetricsServer class
+*/
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <sys/types.h>
+#include "reactor.hpp"
+#include "session.hpp"
+
+/**
+* @class Counter
+* @brief Counter written by one thread and read by any thread
+*
+* Only the owning thread adds, so an addition is a relaxed load and store, plain
+* moves without a locked instruction. Readers load the value at any time.
+* A gauge is a counter changed by both add and sub, its value is read as signed.
+*/
+class Counter {
+public:
+    /**
+    * @brief Increases the counter, called only by the owning thread.
+    * @param amount Amount to add.
+    */
+    void add(uint64_t amount = 1) {
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    /**
+    * @brief Decreases the counter (gauges), called only by the owning thread.
+    * @param amount Amount to subtract.
+    */
+    void sub(uint64_t amount = 1) {
+        value.store(value.load(std::memory_order_relaxed) - amount, std::memory_order_relaxed);
+    }
+
+    /**
+    * @brief Current value.
+    * @return The value.
+    */
+    uint64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> value{0}; /**< The value, only the owner writes */
+};
+
+/**
+* @brief Number of values of the State enumeration
+*/
+const int STATE_COUNT = ERROR + 1;
+
+/**
+* @brief Counters of all sessions running on one thread
+*
+* Every thread gets its own instance from threadMetrics, it is registered on
+* first use. formatMetrics sums the instances of all threads, including the
+* ones that already exited.
+*/
+struct ThreadMetrics {
+    Counter bytesReceived; /**< Bytes of messages from the server */
+    Counter bytesSent; /**< Bytes sent to the server, including CONFIRMs and retransmissions */
+    Counter messagesReceived; /**< Messages from the server, including CONFIRMs and duplicates */
+    Counter messagesSent; /**< Messages sent to the server, including CONFIRMs and retransmissions */
+    Counter retransmissions; /**< Retransmitted UDP messages */
+    Counter expired; /**< UDP messages not confirmed after all retries */
+    Counter duplicates; /**< UDP messages from the server dropped as duplicates */
+    Counter unmatchedReplies; /**< UDP REPLYs dropped, their RefMessageID is not the AUTH or JOIN waiting for REPLY */
+    Counter inflight; /**< Gauge, sent UDP messages not confirmed or replied yet */
+    Counter serverIDs; /**< Gauge, message IDs from the server remembered for deduplication */
+    Counter stateMicroseconds[STATE_COUNT]; /**< Time spent by the sessions in each State */
+
+    /**
+    * @brief Constructor for the ThreadMetrics struct, registers the instance
+    */
+    ThreadMetrics();
+
+    /**
+    * @brief Destructor for the ThreadMetrics struct, keeps the values for formatMetrics
+    */
+    ~ThreadMetrics();
+
+    ThreadMetrics(const ThreadMetrics&) = delete;
+    ThreadMetrics& operator=(const ThreadMetrics&) = delete;
+};
+
+/**
+* @brief Counters of the calling thread.
+* @return The instance of the thread.
+*/
+ThreadMetrics& threadMetrics();
+
+/**
+* @brief Sums the counters of all threads in the Prometheus text format, followed by the counters of the output sinks.
+* @param out Output, replaced by the formatted metrics.
+*/
+void formatMetrics(std::string &out);
+
+/**
+* @class StateClock
+* @brief Adds the time a session spends in each State to the thread counters
+*/
+class StateClock {
+public:
+    /**
+    * @brief Constructor for the StateClock class, starts in START
+    * @param metrics Counters the time is added to.
+    */
+    StateClock(ThreadMetrics &metrics);
+
+    /**
+    * @brief Accounts the time since the last call if the state changed.
+    * @param current Current state of the session.
+    */
+    void update(State current) {
+        if (current != state) {
+            flush(current);
+        }
+    }
+
+    /**
+    * @brief Accounts the time since the last call to the previous state and moves to current.
+    * @param current Current state of the session.
+    */
+    void flush(State current);
+
+private:
+    ThreadMetrics &metrics; /**< Counters of the thread */
+    State state; /**< State since the last call */
+    std::chrono::steady_clock::time_point since; /**< Time of the last call */
+};
+
+/**
+* @class MetricsServer
+* @brief Serves formatMetrics on a local Unix domain socket
+*
+* A connection is answered once its request arrives (or the client shuts down
+* its side) with one HTTP/1.0 response and closed, so both
+* `curl --unix-socket path http://localhost/metrics` and a plain `nc -U path`
+* read the metrics. Everything runs in the event loop of the caller.
+*/
+class MetricsServer {
+public:
+    /**
+    * @brief Destructor for the MetricsServer class, closes and removes the socket
+    */
+    ~MetricsServer();
+
+    /**
+    * @brief Creates the socket and registers it in the reactor.
+    *
+    * A socket at path that refuses connections is left behind by a previous run and
+    * is replaced. A socket that is still served by another process and any other
+    * kind of file are kept and open fails.
+    *
+    * @param path Path of the socket.
+    * @param reactor Event loop serving the connections, it must outlive the server's use.
+    * @param refresh Called before the metrics are formatted, may be empty.
+    * @return false if the socket cannot be created, failure tells why.
+    */
+    bool open(const std::string &path, Reactor &reactor, std::function<void()> refresh = nullptr);
+
+    /**
+    * @brief Reason of the last failed open.
+    * @return Short description ("in use", "not a socket", ...), nullptr if open did not fail.
+    */
+    const char* failure() const;
+
+private:
+    /**
+    * @brief Accepts every pending connection and waits for its request.
+    */
+    void acceptClients();
+
+    /**
+    * @brief Sends the response to a connection whose request arrived and closes it.
+    * @param client Socket of the connection.
+    */
+    void respond(int client);
+
+    Reactor* reactor = nullptr; /**< Event loop the sockets are registered in */
+    std::function<void()> refresh; /**< Called before formatting */
+    int listenFd = -1; /**< Listening socket */
+    std::string socketPath; /**< Path removed by the destructor */
+    dev_t boundDevice = 0; /**< Device of the bound socket file */
+    ino_t boundInode = 0; /**< Inode of the bound socket file, the destructor removes only this file */
+    const char* failureReason = nullptr; /**< Why open failed */
+    std::string body; /**< Formatted metrics, the buffer is reused */
+    std::string response; /**< HTTP response, the buffer is reused */
+};
+
+#endif /* METRICS_HPP */
@@ -0,0 +1,632 @@
+/**
+* @file mockserver.cpp
+* @brief Local IPK24-CHAT server for testing and benchmarking the client
+*
+* Serves TCP and UDP clients on the same port of the loopback interface. Clients
+* authorize (every AUTH is accepted), join channels and their MSGs are sent to
+* the other clients in the same channel, whatever transport they use. UDP
+* messages are confirmed and the server retransmits its own messages until they
+* are confirmed. The REPLY can be delayed and the UDP datagrams sent by the
+* server can be lost, duplicated or reordered, the impairments are drawn from a
+* seeded generator so a run can be repeated.
+*/
+#include <iostream>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <csignal>
+#include <cstdlib>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "codec.hpp"
+#include "framer.hpp"
+#include "dedup.hpp"
+#include "pool.hpp"
+#include "reactor.hpp"
+#include "options.hpp"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+/**
+* @brief Behaviour of the server
+*/
+struct MockConfig {
+    uint16_t port = 4567; /**< TCP and UDP port */
+    int replyDelayMs = 0; /**< Delay of every REPLY */
+    int lossPercent = 0; /**< Probability of losing a UDP datagram, both directions */
+    int duplicatePercent = 0; /**< Probability of sending a UDP datagram twice */
+    int reorderPercent = 0; /**< Probability of holding a UDP datagram back by REORDER_DELAY_MS */
+    int d = 250; /**< UDP retransmission timeout in milliseconds */
+    int r = 3; /**< UDP retries */
+    unsigned seed = 1; /**< Seed of the impairments */
+    bool verbose = false; /**< Log the messages from the clients */
+};
+
+/**
+* @brief Message sent by the server and not confirmed yet (UDP)
+*/
+struct Unconfirmed {
+    vector<unsigned char> datagram; /**< Encoded message */
+    int retries; /**< Retransmissions left */
+};
+
+/**
+* @brief One connected client
+*/
+struct Client {
+    int id; /**< Number of the client, used in the scheduled events */
+    bool udp; /**< Transport of the client */
+    int fd = -1; /**< TCP connection */
+    struct sockaddr_in address; /**< UDP address */
+    Framer framer; /**< TCP message reassembly */
+    string output; /**< TCP data not accepted by the socket yet */
+    bool authorized = false; /**< The client has sent AUTH */
+    bool closing = false; /**< The client is removed once its output is delivered */
+    string displayName; /**< Display name of the client */
+    string channel; /**< Current channel */
+    uint16_t nextID = 0; /**< ID of the next UDP message of the server */
+    DuplicateWindow seen; /**< UDP message IDs received from the client */
+    map<uint16_t, Unconfirmed> unconfirmed; /**< UDP messages waiting for CONFIRM */
+};
+
+// Reads a 16-bit ID in network byte order
+static uint16_t readID(const char* data) {
+    return (static_cast<uint8_t>(data[0]) << 8) | static_cast<uint8_t>(data[1]);
+}
+
+/**
+* @class MockServer
+* @brief Accepts the clients and runs the chat in one Reactor
+*/
+class MockServer {
+public:
+    /**
+    * @brief Constructor for the MockServer class
+    * @param config Behaviour of the server.
+    */
+    MockServer(const MockConfig &config) : config(config), random(config.seed) {}
+
+    /**
+    * @brief Opens the sockets and serves the clients until SIGINT.
+    * @return false if a socket cannot be opened.
+    */
+    bool run();
+
+private:
+    static constexpr int REORDER_DELAY_MS = 20; /**< How long a reordered datagram is held back */
+    static constexpr int UDP_BUFFER_SIZE = 4 << 20; /**< Requested receive buffer, capped by net.core.rmem_max */
+
+    /**
+    * @brief Calls action after delayMs from the event loop.
+    */
+    void schedule(int delayMs, function<void()> action);
+
+    /**
+    * @brief Draws an impairment with the given probability.
+    */
+    bool chance(int percent);
+
+    void acceptClients();
+    void readTcp(Client &client);
+    void writeTcp(Client &client);
+    void readUdp();
+
+    /**
+    * @brief Acts on one message from a client.
+    * @param valid The message was decoded, otherwise the client gets ERR and BYE.
+    */
+    void handle(Client &client, bool valid, const ClientMessage &request);
+
+    /**
+    * @brief Sends MSG from sender to every other client in the channel.
+    */
+    void broadcast(const Client* sender, const string &channel, string_view from, string_view content);
+
+    void sendReply(Client &client, bool ok, string_view content, uint16_t refMessageID);
+    void sendMsg(Client &client, string_view from, string_view content);
+    void sendErr(Client &client, string_view content);
+    void sendBye(Client &client);
+
+    /**
+    * @brief Encodes a message for the transport of the client and sends it.
+    */
+    void sendMessage(Client &client, const ServerMessage &message);
+
+    /**
+    * @brief Queues text for a TCP client and writes as much as the socket takes.
+    */
+    void sendText(Client &client, const string &text);
+
+    /**
+    * @brief Sends a UDP message and retransmits it until it is confirmed.
+    */
+    void sendReliable(Client &client, PacketBuffer &message);
+
+    /**
+    * @brief Retransmits a UDP message if it is still not confirmed.
+    */
+    void retransmit(int clientId, uint16_t messageID);
+
+    /**
+    * @brief Sends a datagram through the loss, duplication and reordering.
+    */
+    void emit(const struct sockaddr_in &address, const unsigned char* data, size_t length);
+
+    /**
+    * @brief Removes the client now, or once its output is delivered.
+    */
+    void closeClient(Client &client);
+
+    /**
+    * @brief Removes the client if it is closing and nothing waits for delivery.
+    */
+    void reap(Client &client);
+
+    Client* find(int clientId);
+    void log(const Client &client, const char* what, string_view detail);
+
+    const MockConfig &config; /**< Behaviour of the server */
+    mt19937 random; /**< Generator of the impairments */
+    Reactor reactor; /**< Event loop */
+    int listenFd = -1; /**< TCP listening socket */
+    int udpFd = -1; /**< UDP socket */
+    int nextClientId = 0; /**< ID of the next client */
+    map<int, unique_ptr<Client>> clients; /**< Connected clients by ID */
+    map<uint64_t, int> udpClients; /**< IDs of the UDP clients by address */
+    multimap<Clock::time_point, function<void()>> events; /**< Scheduled events */
+    uint16_t replyRef = 0; /**< Reference ID of the REPLY being sent (UDP) */
+    string encoded; /**< Reused buffer of the encoded TCP messages */
+};
+
+// Key of a UDP client in udpClients
+static uint64_t addressKey(const struct sockaddr_in &address) {
+    return (static_cast<uint64_t>(address.sin_addr.s_addr) << 16) | address.sin_port;
+}
+
+bool MockServer::run() {
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(config.port);
+
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (listenFd < 0) {
+        cerr << "TCP socket creation error" << endl;
+        return false;
+    }
+    int enable = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    if (bind(listenFd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listenFd, SOMAXCONN) < 0) {
+        cerr << "TCP socket cannot listen on port " << config.port << endl;
+        return false;
+    }
+    udpFd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (udpFd < 0) {
+        cerr << "UDP socket creation error" << endl;
+        return false;
+    }
+    // All UDP clients share the socket, CONFIRMs of a fan-out arrive in a burst
+    int bufferSize = UDP_BUFFER_SIZE;
+    setsockopt(udpFd, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+    if (bind(udpFd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        cerr << "UDP socket cannot bind port " << config.port << endl;
+        return false;
+    }
+
+    reactor.add(listenFd, EPOLLIN, [this](uint32_t) { acceptClients(); });
+    reactor.add(udpFd, EPOLLIN, [this](uint32_t) { readUdp(); });
+    reactor.onTimer([this]() {
+        auto now = Clock::now();
+        while (!events.empty() && events.begin()->first <= now) {
+            function<void()> action = std::move(events.begin()->second);
+            events.erase(events.begin());
+            action();
+        }
+    });
+    reactor.onPrepare([this]() {
+        if (events.empty()) {
+            return -1;
+        }
+        auto remaining = chrono::duration_cast<chrono::milliseconds>(events.begin()->first - Clock::now()).count();
+        return remaining > 0 ? static_cast<int>(remaining) : 0;
+    });
+    reactor.onSignal(SIGINT, [this]() { reactor.stop(); });
+    cerr << "Listening on 127.0.0.1:" << config.port << " (TCP and UDP)" << endl;
+    bool ok = reactor.run();
+    if (!ok) {
+        cerr << reactor.failure() << endl;
+    }
+
+    for (auto &entry : clients) {
+        if (!entry.second->udp) {
+            close(entry.second->fd);
+        }
+    }
+    close(udpFd);
+    close(listenFd);
+    return ok;
+}
+
+void MockServer::schedule(int delayMs, function<void()> action) {
+    events.emplace(Clock::now() + chrono::milliseconds(delayMs), std::move(action));
+}
+
+bool MockServer::chance(int percent) {
+    return percent > 0 && static_cast<int>(random() % 100) < percent;
+}
+
+Client* MockServer::find(int clientId) {
+    auto it = clients.find(clientId);
+    return it == clients.end() ? nullptr : it->second.get();
+}
+
+void MockServer::log(const Client &client, const char* what, string_view detail) {
+    if (config.verbose) {
+        cerr << "client " << client.id << " (" << (client.udp ? "udp" : "tcp") << "): " << what << " " << detail << endl;
+    }
+}
+
+void MockServer::acceptClients() {
+    int fd;
+    while ((fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK)) >= 0) {
+        unique_ptr<Client> client(new Client());
+        client->id = nextClientId++;
+        client->udp = false;
+        client->fd = fd;
+        int id = client->id;
+        reactor.add(fd, EPOLLIN, [this, id](uint32_t events) {
+            Client* client = find(id);
+            if (client == nullptr) {
+                return;
+            }
+            if (events & EPOLLOUT) {
+                writeTcp(*client);
+            }
+            if ((client = find(id)) != nullptr && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+                readTcp(*client);
+            }
+        });
+        log(*client, "connected", "");
+        clients[id] = std::move(client);
+    }
+}
+
+void MockServer::readTcp(Client &client) {
+    ssize_t bytesRead = client.framer.readFrom(client.fd);
+    if (bytesRead <= 0) {
+        if (bytesRead < 0 && errno == EAGAIN) {
+            return;
+        }
+        // The client went away without BYE
+        client.output.clear();
+        closeClient(client);
+        return;
+    }
+    int id = client.id;
+    string_view line;
+    while (find(id) != nullptr && !client.closing && client.framer.next(line)) {
+        ClientMessage request;
+        bool valid = decodeText(line, request);
+        handle(client, valid, request);
+    }
+}
+
+void MockServer::writeTcp(Client &client) {
+    while (!client.output.empty()) {
+        ssize_t bytesSent = send(client.fd, client.output.data(), client.output.size(), MSG_NOSIGNAL);
+        if (bytesSent < 0) {
+            if (errno == EAGAIN) {
+                reactor.modify(client.fd, EPOLLIN | EPOLLOUT);
+                return;
+            }
+            client.output.clear();
+            break;
+        }
+        client.output.erase(0, bytesSent);
+    }
+    reactor.modify(client.fd, EPOLLIN);
+    reap(client);
+}
+
+void MockServer::readUdp() {
+    char buffer[PacketBuffer::CAPACITY + 1];
+    struct sockaddr_in address;
+    socklen_t addressLength = sizeof(address);
+    ssize_t length;
+    while ((length = recvfrom(udpFd, buffer, sizeof(buffer), 0, (struct sockaddr *)&address, &addressLength)) >= 0) {
+        addressLength = sizeof(address);
+        if (length < 3 || chance(config.lossPercent)) {
+            continue;
+        }
+        uint64_t key = addressKey(address);
+        auto known = udpClients.find(key);
+        Client* client = known == udpClients.end() ? nullptr : find(known->second);
+        uint16_t messageID = readID(buffer + 1);
+        if (buffer[0] == 0x00) {
+            if (client != nullptr) {
+                client->unconfirmed.erase(messageID);
+                reap(*client);
+            }
+            continue;
+        }
+        if (client == nullptr) {
+            unique_ptr<Client> created(new Client());
+            created->id = nextClientId++;
+            created->udp = true;
+            created->address = address;
+            client = created.get();
+            udpClients[key] = client->id;
+            clients[client->id] = std::move(created);
+            log(*client, "connected", "");
+        }
+        unsigned char confirm[3] = {0x00, static_cast<unsigned char>(messageID >> 8), static_cast<unsigned char>(messageID & 0xFF)};
+        emit(address, confirm, sizeof(confirm));
+        if (client->closing || client->seen.contains(messageID)) {
+            continue;
+        }
+        client->seen.insert(messageID);
+        ClientMessage request;
+        bool valid = decodeDatagram(buffer, length, request);
+        replyRef = messageID;
+        handle(*client, valid, request);
+    }
+}
+
+void MockServer::handle(Client &client, bool valid, const ClientMessage &request) {
+    if (!valid) {
+        log(client, "invalid message", "");
+        sendErr(client, "Invalid message.");
+        sendBye(client);
+        closeClient(client);
+        return;
+    }
+    switch (request.kind) {
+    case CLIENT_AUTH:
+        log(client, "AUTH", request.username);
+        if (client.authorized) {
+            sendReply(client, false, "Already authorized.", replyRef);
+            break;
+        }
+        client.authorized = true;
+        client.displayName = string(request.displayName);
+        client.channel = "general";
+        sendReply(client, true, "Auth success.", replyRef);
+        broadcast(&client, client.channel, "Server", client.displayName + " has joined " + client.channel + ".");
+        break;
+    case CLIENT_JOIN:
+        log(client, "JOIN", request.channelID);
+        if (!client.authorized) {
+            sendErr(client, "Not authorized.");
+            closeClient(client);
+            break;
+        }
+        client.displayName = string(request.displayName);
+        broadcast(&client, client.channel, "Server", client.displayName + " has left " + client.channel + ".");
+        client.channel = string(request.channelID);
+        sendReply(client, true, "Join success.", replyRef);
+        broadcast(&client, client.channel, "Server", client.displayName + " has joined " + client.channel + ".");
+        break;
+    case CLIENT_MSG:
+        log(client, "MSG", request.content);
+        if (!client.authorized) {
+            sendErr(client, "Not authorized.");
+            closeClient(client);
+            break;
+        }
+        client.displayName = string(request.displayName);
+        broadcast(&client, client.channel, client.displayName, request.content);
+        break;
+    case CLIENT_ERR:
+        log(client, "ERR", request.content);
+        sendBye(client);
+        closeClient(client);
+        break;
+    case CLIENT_BYE:
+        log(client, "BYE", "");
+        if (client.authorized) {
+            broadcast(&client, client.channel, "Server", client.displayName + " has left " + client.channel + ".");
+        }
+        client.authorized = false;
+        closeClient(client);
+        break;
+    }
+}
+
+void MockServer::broadcast(const Client* sender, const string &channel, string_view from, string_view content) {
+    for (auto &entry : clients) {
+        Client &client = *entry.second;
+        if (&client != sender && client.authorized && !client.closing && client.channel == channel) {
+            sendMsg(client, from, content);
+        }
+    }
+}
+
+void MockServer::sendReply(Client &client, bool ok, string_view content, uint16_t refMessageID) {
+    int id = client.id;
+    string text(content);
+    auto reply = [this, id, ok, text, refMessageID]() {
+        Client* client = find(id);
+        if (client == nullptr || client->closing) {
+            return;
+        }
+        ServerMessage message = {KIND_REPLY, "", text, ok, refMessageID};
+        sendMessage(*client, message);
+    };
+    if (config.replyDelayMs > 0) {
+        schedule(config.replyDelayMs, reply);
+    } else {
+        reply();
+    }
+}
+
+void MockServer::sendMsg(Client &client, string_view from, string_view content) {
+    sendMessage(client, {KIND_MSG, from, content, false, 0});
+}
+
+void MockServer::sendErr(Client &client, string_view content) {
+    sendMessage(client, {KIND_ERR, "Server", content, false, 0});
+}
+
+void MockServer::sendBye(Client &client) {
+    sendMessage(client, {KIND_BYE, "", "", false, 0});
+}
+
+void MockServer::sendMessage(Client &client, const ServerMessage &message) {
+    if (!client.udp) {
+        encodeText(message, encoded);
+        sendText(client, encoded);
+        return;
+    }
+    PacketBuffer datagram;
+    if (encodeDatagram(message, client.nextID, datagram)) {
+        sendReliable(client, datagram);
+    }
+}
+
+void MockServer::sendText(Client &client, const string &text) {
+    bool idle = client.output.empty();
+    client.output += text;
+    if (idle) {
+        writeTcp(client);
+    }
+}
+
+void MockServer::sendReliable(Client &client, PacketBuffer &message) {
+    uint16_t messageID = client.nextID++;
+    Unconfirmed &entry = client.unconfirmed[messageID];
+    entry.datagram.assign(message.data, message.data + message.length);
+    entry.retries = config.r;
+    emit(client.address, message.data, message.length);
+    int id = client.id;
+    schedule(config.d, [this, id, messageID]() { retransmit(id, messageID); });
+}
+
+void MockServer::retransmit(int clientId, uint16_t messageID) {
+    Client* client = find(clientId);
+    if (client == nullptr) {
+        return;
+    }
+    auto it = client->unconfirmed.find(messageID);
+    if (it == client->unconfirmed.end()) {
+        return;
+    }
+    if (it->second.retries == 0) {
+        // The client is gone, forget about it
+        log(*client, "no CONFIRM of", to_string(messageID));
+        client->unconfirmed.clear();
+        client->closing = true;
+        reap(*client);
+        return;
+    }
+    --it->second.retries;
+    emit(client->address, it->second.datagram.data(), it->second.datagram.size());
+    schedule(config.d, [this, clientId, messageID]() { retransmit(clientId, messageID); });
+}
+
+void MockServer::emit(const struct sockaddr_in &address, const unsigned char* data, size_t length) {
+    if (chance(config.lossPercent)) {
+        return;
+    }
+    int copies = chance(config.duplicatePercent) ? 2 : 1;
+    if (chance(config.reorderPercent)) {
+        // Later datagrams overtake this one
+        vector<unsigned char> held(data, data + length);
+        schedule(REORDER_DELAY_MS, [this, address, held, copies]() {
+            for (int i = 0; i < copies; ++i) {
+                sendto(udpFd, held.data(), held.size(), 0, (const struct sockaddr *)&address, sizeof(address));
+            }
+        });
+        return;
+    }
+    for (int i = 0; i < copies; ++i) {
+        sendto(udpFd, data, length, 0, (const struct sockaddr *)&address, sizeof(address));
+    }
+}
+
+void MockServer::closeClient(Client &client) {
+    client.closing = true;
+    reap(client);
+}
+
+void MockServer::reap(Client &client) {
+    if (!client.closing || !client.output.empty() || !client.unconfirmed.empty()) {
+        return;
+    }
+    log(client, "closed", "");
+    if (client.udp) {
+        udpClients.erase(addressKey(client.address));
+    } else {
+        reactor.remove(client.fd);
+        close(client.fd);
+    }
+    clients.erase(client.id);
+}
+
+int main(int argc, char *argv[])
+{
+    MockConfig config;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:D:l:u:o:d:r:S:vh")) != -1) {
+        switch (opt) {
+            case 'p':
+                config.port = static_cast<uint16_t>(numberOption(optarg, 0, UINT16_MAX, "port number"));
+                break;
+            case 'D':
+                config.replyDelayMs = numberOption(optarg, 0, 60000, "reply delay");
+                break;
+            case 'l':
+                config.lossPercent = numberOption(optarg, 0, 100, "loss");
+                break;
+            case 'u':
+                config.duplicatePercent = numberOption(optarg, 0, 100, "duplication");
+                break;
+            case 'o':
+                config.reorderPercent = numberOption(optarg, 0, 100, "reordering");
+                break;
+            case 'd':
+                config.d = numberOption(optarg, 1, UINT16_MAX, "time number");
+                break;
+            case 'r':
+                config.r = numberOption(optarg, 0, UINT8_MAX, "retries number");
+                break;
+            case 'S':
+                config.seed = static_cast<unsigned>(numberOption(optarg, 0, INT32_MAX, "seed"));
+                break;
+            case 'v':
+                config.verbose = true;
+                break;
+            case 'h':
+                cout << "Usage: ./ipk24chat-mockserver [options]" << endl;
+                cout << endl;
+                cout << "Serves TCP and UDP clients on 127.0.0.1, stops on ctrl+c." << endl;
+                cout << "   - `-p port`: TCP and UDP port (uint16, default value 4567)" << endl;
+                cout << "   - `-D delay`: delay of every REPLY in ms (default value 0)" << endl;
+                cout << "   - `-l percent`: UDP datagrams lost in both directions (default value 0)" << endl;
+                cout << "   - `-u percent`: UDP datagrams of the server sent twice (default value 0)" << endl;
+                cout << "   - `-o percent`: UDP datagrams of the server held back by 20 ms (default value 0)" << endl;
+                cout << "   - `-d timer`, `-r retries`: UDP retransmission of the server (default values 250 ms, 3)" << endl;
+                cout << "   - `-S seed`: seed of the impairments (default value 1)" << endl;
+                cout << "   - `-v`: log the messages from the clients" << endl;
+                cout << "   - `-h`: help" << endl;
+                exit(0);
+            default:
+                cerr << "For help use -h" << endl;
+                exit(-1);
+        }
+    }
+
+    MockServer server(config);
+    return server.run() ? 0 : 1;
+}
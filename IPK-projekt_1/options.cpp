@@ -0,0 +1,23 @@
+#include "options.hpp"
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+
+int numberOption(const char* value, int minimum, int maximum, const char* name) {
+    for (size_t i = 0; value[i] != '\0'; ++i) {
+        if (!isdigit(static_cast<unsigned char>(value[i]))) {
+            cerr << "Invalid parameter: " << value << ". Please provide a valid numerical value." << endl;
+            exit(-1);
+        }
+    }
+    errno = 0;
+    long parsed = strtol(value, nullptr, 10);
+    if (value[0] == '\0' || errno == ERANGE || parsed < minimum || parsed > maximum) {
+        cerr << "Invalid " << name << ". Please provide a value from " << minimum << " to " << maximum << "." << endl;
+        exit(-1);
+    }
+    return static_cast<int>(parsed);
+}
@@ -0,0 +1,18 @@
+/**
+* @file options.hpp
+* @brief Parsing of the numeric command line options of the load generator and the mock server
+*/
+#ifndef OPTIONS_HPP
+#define OPTIONS_HPP
+
+/**
+* @brief Parses a non-negative number option, exits on an invalid value.
+* @param value Argument of the option.
+* @param minimum Smallest allowed value.
+* @param maximum Largest allowed value.
+* @param name Name of the value in the error message.
+* @return The parsed value.
+*/
+int numberOption(const char* value, int minimum, int maximum, const char* name);
+
+#endif /* OPTIONS_HPP */
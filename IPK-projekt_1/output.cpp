@@ -0,0 +1,254 @@
+#include "output.hpp"
+#include "session.hpp"
+#include <algorithm>
+#include <chrono>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+using namespace std;
+
+static const char* policyNames[] = {"block", "drop", "summarize"};
+
+// Writes all parts, partial writes continue where they stopped
+static void writeAll(int fd, struct iovec* parts, int count){
+    while (count > 0) {
+        ssize_t written = writev(fd, parts, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                // Another process made the shared descriptor non-blocking
+                struct pollfd writable = {fd, POLLOUT, 0};
+                poll(&writable, 1, -1);
+                continue;
+            }
+            // The lines are lost, as with a failed cout
+            return;
+        }
+        while (count > 0 && static_cast<size_t>(written) >= parts->iov_len) {
+            written -= parts->iov_len;
+            ++parts;
+            --count;
+        }
+        if (count > 0) {
+            parts->iov_base = static_cast<char*>(parts->iov_base) + written;
+            parts->iov_len -= written;
+        }
+    }
+}
+
+OutputSink::OutputSink(int fd, size_t capacity) : fd(fd), pending(capacity), writing(capacity) {}
+
+OutputSink::~OutputSink(){
+    finish();
+}
+
+void OutputSink::writeLine(initializer_list<string_view> parts){
+    size_t length = 1;
+    for (string_view part : parts) {
+        length += part.size();
+    }
+    unique_lock<mutex> lock(access);
+    if (length > pending.size() && writer.joinable() && overload != OVERLOAD_BLOCK) {
+        // Would not fit even into an empty buffer, it is the one dropped
+        counters.dropped++;
+        if (overload == OVERLOAD_SUMMARIZE) {
+            suppressed++;
+        }
+        return;
+    }
+    if (length > pending.size() - (end - start)) {
+        makeRoom(lock, min(length, pending.size()));
+        if (length > pending.size()) {
+            // The buffer is empty and the writer idle now, so the order holds
+            vector<struct iovec> pieces;
+            for (string_view part : parts) {
+                pieces.push_back({const_cast<char*>(part.data()), part.size()});
+            }
+            pieces.push_back({const_cast<char*>("\n"), 1});
+            writeAll(fd, pieces.data(), pieces.size());
+            counters.lines++;
+            counters.writes++;
+            return;
+        }
+    }
+    if (end + length > pending.size()) {
+        // Dropped lines left space at the front
+        memmove(pending.data(), pending.data() + start, end - start);
+        end -= start;
+        start = 0;
+    }
+    for (string_view part : parts) {
+        memcpy(pending.data() + end, part.data(), part.size());
+        end += part.size();
+    }
+    pending[end++] = '\n';
+    lines.push_back(length);
+    counters.lines++;
+}
+
+void OutputSink::flush(){
+    lock_guard<mutex> lock(access);
+    if (end == start && suppressed == 0) {
+        return;
+    }
+    if (writer.joinable()) {
+        requested = true;
+        wake.notify_one();
+        return;
+    }
+    take();
+    writeTaken();
+}
+
+void OutputSink::startWriter(){
+    writer = thread([this]() { writerLoop(); });
+}
+
+void OutputSink::finish(){
+    {
+        lock_guard<mutex> lock(access);
+        if (!writer.joinable()) {
+            if (end != start || suppressed > 0) {
+                take();
+                writeTaken();
+            }
+            return;
+        }
+        stopping = true;
+        wake.notify_one();
+    }
+    // The writer writes the rest before it exits
+    writer.join();
+    stopping = false;
+}
+
+void OutputSink::setPolicy(OverloadPolicy policy){
+    lock_guard<mutex> lock(access);
+    overload = policy;
+}
+
+OutputStats OutputSink::stats(){
+    lock_guard<mutex> lock(access);
+    OutputStats copy = counters;
+    copy.policy = overload;
+    return copy;
+}
+
+void OutputSink::printStats(ostream &out, const char* name){
+    OutputStats current = stats();
+    out << name << ": " << current.lines << " lines in " << current.writes << " writes, "
+        << current.dropped << " dropped, " << current.summaries << " summaries, blocked "
+        << current.blocked << " times for " << current.blockedMicroseconds / 1000.0 << " ms (policy "
+        << overloadPolicyName(current.policy) << ")" << endl;
+}
+
+void OutputSink::take(){
+    swap(pending, writing);
+    writingStart = start;
+    writingLength = end - start;
+    start = 0;
+    end = 0;
+    lines.clear();
+    summary.clear();
+    if (suppressed > 0) {
+        // The dropped lines were the oldest ones, the summary takes their place
+        summary.append(to_string(suppressed)).append(" messages suppressed\n");
+        suppressed = 0;
+        counters.summaries++;
+    }
+    counters.writes++;
+}
+
+void OutputSink::writeTaken(){
+    struct iovec parts[2];
+    int count = 0;
+    if (!summary.empty()) {
+        parts[count++] = {summary.data(), summary.size()};
+    }
+    if (writingLength > 0) {
+        parts[count++] = {writing.data() + writingStart, writingLength};
+    }
+    writeAll(fd, parts, count);
+}
+
+void OutputSink::makeRoom(unique_lock<mutex> &lock, size_t needed){
+    if (!writer.joinable()) {
+        take();
+        writeTaken();
+        return;
+    }
+    if (overload == OVERLOAD_BLOCK) {
+        requested = true;
+        wake.notify_one();
+        auto since = chrono::steady_clock::now();
+        // A line longer than the buffer also needs the previous write finished
+        space.wait(lock, [&]() { return pending.size() - (end - start) >= needed && (needed < pending.size() || !busy); });
+        counters.blocked++;
+        counters.blockedMicroseconds += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - since).count();
+        return;
+    }
+    while (!lines.empty() && pending.size() - (end - start) < needed) {
+        start += lines.front();
+        lines.pop_front();
+        counters.dropped++;
+        if (overload == OVERLOAD_SUMMARIZE) {
+            suppressed++;
+        }
+    }
+}
+
+void OutputSink::writerLoop(){
+    unique_lock<mutex> lock(access);
+    while (true) {
+        wake.wait(lock, [this]() { return requested || stopping; });
+        requested = false;
+        if (end == start && suppressed == 0) {
+            if (stopping) {
+                return;
+            }
+            continue;
+        }
+        // The producers fill the other buffer while this one is written
+        take();
+        busy = true;
+        lock.unlock();
+        writeTaken();
+        lock.lock();
+        busy = false;
+        space.notify_all();
+    }
+}
+
+const char* overloadPolicyName(OverloadPolicy policy){
+    return policyNames[policy];
+}
+
+bool parseOverloadPolicy(string_view name, OverloadPolicy &policy){
+    for (int i = OVERLOAD_BLOCK; i <= OVERLOAD_SUMMARIZE; ++i) {
+        if (name == policyNames[i]) {
+            policy = static_cast<OverloadPolicy>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+OutputSink& standardOutput(){
+    static OutputSink sink(STDOUT_FILENO);
+    return sink;
+}
+
+OutputSink& standardError(){
+    static OutputSink sink(STDERR_FILENO);
+    return sink;
+}
+
+void printAction(const Action &action){
+    OutputSink &out = action.error ? standardError() : standardOutput();
+    out.writeLine({action.prefix, action.name, action.name.empty() ? "" : ": ", action.text});
+}
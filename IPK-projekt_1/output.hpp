@@ -0,0 +1,200 @@
+/**
+* @file output.hpp
+* @brief Header file for the OutputSink class
+*/
+#ifndef OUTPUT_HPP
+#define OUTPUT_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <initializer_list>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+struct Action;
+
+/**
+* @brief What writeLine does when the buffer is full
+*/
+enum OverloadPolicy {
+    OVERLOAD_BLOCK,     /**< Wait until the writer makes room, nothing is lost */
+    OVERLOAD_DROP,      /**< Drop the oldest buffered lines and count them */
+    OVERLOAD_SUMMARIZE  /**< Drop the oldest buffered lines and print "N messages suppressed" in their place */
+};
+
+/**
+* @brief Counters of an OutputSink
+*/
+struct OutputStats {
+    OverloadPolicy policy = OVERLOAD_BLOCK; /**< Policy of the sink */
+    uint64_t lines = 0; /**< Lines accepted by writeLine */
+    uint64_t writes = 0; /**< writev calls */
+    uint64_t dropped = 0; /**< Lines dropped by the overload policy */
+    uint64_t summaries = 0; /**< "N messages suppressed" lines written */
+    uint64_t blocked = 0; /**< Times writeLine waited for the writer thread */
+    uint64_t blockedMicroseconds = 0; /**< Total time writeLine waited */
+};
+
+/**
+* @class OutputSink
+* @brief Buffered output of the lines printed to the user
+*
+* Lines are copied into a bounded buffer instead of being written one by one
+* with endl. flush writes everything buffered with a single writev, the event
+* loop calls it once per iteration. With startWriter the writes move to a
+* dedicated thread: the buffer is swapped with a second one the thread writes
+* from and flush only wakes it, so a slow terminal, pipe or file never stalls
+* the event loop. When the consumer falls behind and the buffer fills up, the
+* OverloadPolicy decides between waiting and dropping the oldest lines.
+*/
+class OutputSink {
+public:
+    /**
+    * @brief Constructor for the OutputSink class
+    * @param fd Descriptor the lines are written to.
+    * @param capacity Size of the buffer in bytes.
+    */
+    OutputSink(int fd, size_t capacity = 65536);
+
+    /**
+    * @brief Destructor for the OutputSink class, writes the rest and stops the writer thread
+    */
+    ~OutputSink();
+
+    OutputSink(const OutputSink&) = delete;
+    OutputSink& operator=(const OutputSink&) = delete;
+
+    /**
+    * @brief Appends one line made of the given parts and a newline.
+    *
+    * A full buffer is written right away without the writer thread, otherwise
+    * the overload policy applies.
+    *
+    * @param parts Parts of the line.
+    */
+    void writeLine(std::initializer_list<std::string_view> parts);
+
+    /**
+    * @brief Writes the buffered lines, or wakes the writer thread to write them.
+    */
+    void flush();
+
+    /**
+    * @brief Moves the writes to a dedicated thread.
+    */
+    void startWriter();
+
+    /**
+    * @brief Writes everything buffered and stops the writer thread, if any.
+    *
+    * The sink keeps working afterwards, flush writes directly again.
+    */
+    void finish();
+
+    /**
+    * @brief Sets what happens when the buffer is full, only the writer thread can fall behind.
+    * @param policy The policy.
+    */
+    void setPolicy(OverloadPolicy policy);
+
+    /**
+    * @brief Current values of the counters.
+    * @return Copy of the counters.
+    */
+    OutputStats stats();
+
+    /**
+    * @brief Prints the counters and the policy.
+    * @param out Output stream.
+    * @param name Name of the stream in the output.
+    */
+    void printStats(std::ostream &out, const char* name);
+
+private:
+    /**
+    * @brief Swaps the buffered lines into the writing buffer, called with the lock held.
+    */
+    void take();
+
+    /**
+    * @brief Writes the taken lines with one writev, preceded by the summary if there is one.
+    */
+    void writeTaken();
+
+    /**
+    * @brief Frees space in the buffer, called with the lock held.
+    *
+    * Without the writer thread everything buffered is written. Otherwise
+    * OVERLOAD_BLOCK wakes the writer and waits until it frees enough space,
+    * the other policies drop the oldest lines.
+    *
+    * @param lock Lock of the mutex, released while waiting for the writer.
+    * @param needed Number of free bytes needed.
+    */
+    void makeRoom(std::unique_lock<std::mutex> &lock, size_t needed);
+
+    /**
+    * @brief Body of the writer thread.
+    */
+    void writerLoop();
+
+    int fd; /**< Output descriptor */
+    std::vector<char> pending; /**< Buffered lines between start and end */
+    size_t start = 0; /**< Start of the oldest buffered line */
+    size_t end = 0; /**< End of the buffered lines */
+    std::deque<size_t> lines; /**< Lengths of the buffered lines, oldest first */
+    std::vector<char> writing; /**< Lines taken for writing */
+    size_t writingStart = 0; /**< Start of the taken lines */
+    size_t writingLength = 0; /**< Length of the taken lines */
+    std::string summary; /**< "N messages suppressed" line written before the taken lines */
+    uint64_t suppressed = 0; /**< Lines dropped since the last summary (OVERLOAD_SUMMARIZE) */
+    OverloadPolicy overload = OVERLOAD_BLOCK; /**< Policy for a full buffer */
+    OutputStats counters; /**< Counters */
+    std::mutex access; /**< Protects everything except the taken lines and the summary */
+    std::condition_variable wake; /**< Signals the writer thread */
+    std::condition_variable space; /**< Signals a producer waiting for room */
+    std::thread writer; /**< Writer thread, not joinable without startWriter */
+    bool busy = false; /**< The writer thread is writing the taken lines */
+    bool requested = false; /**< flush was called since the writer took the lines */
+    bool stopping = false; /**< finish was called */
+};
+
+/**
+* @brief Name of a policy as accepted by parseOverloadPolicy.
+* @param policy The policy.
+* @return block, drop or summarize.
+*/
+const char* overloadPolicyName(OverloadPolicy policy);
+
+/**
+* @brief Parses the name of a policy.
+* @param name block, drop or summarize.
+* @param policy Output policy.
+* @return false for an unknown name.
+*/
+bool parseOverloadPolicy(std::string_view name, OverloadPolicy &policy);
+
+/**
+* @brief Sink of stdout.
+* @return The instance.
+*/
+OutputSink& standardOutput();
+
+/**
+* @brief Sink of stderr.
+* @return The instance.
+*/
+OutputSink& standardError();
+
+/**
+* @brief Prints an ACTION_PRINT action of the session to the stdout or stderr sink.
+* @param action The action.
+*/
+void printAction(const Action &action);
+
+#endif /* OUTPUT_HPP */
@@ -0,0 +1,9 @@
+#include "parser.hpp"
+#include "schema.hpp"
+
+using namespace std;
+
+bool parseServerMessage(string_view line, ServerMessage &message) {
+    // The grammar of every message is generated from its layout in schema.hpp
+    return ServerSchema::decodeText(line, message);
+}
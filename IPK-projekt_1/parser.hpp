@@ -0,0 +1,48 @@
+/**
+* @file parser.hpp
+* @brief Header file for the parser of the TCP text grammar
+*/
+#ifndef PARSER_HPP
+#define PARSER_HPP
+
+#include <cstdint>
+#include <string_view>
+
+/**
+* @brief Kind of a message received from the server over TCP
+*/
+enum MessageKind {
+    KIND_INVALID, /**< Message does not match the grammar */
+    KIND_REPLY,   /**< REPLY {OK|NOK} IS {MessageContent} */
+    KIND_MSG,     /**< MSG FROM {DisplayName} IS {MessageContent} */
+    KIND_ERR,     /**< ERR FROM {DisplayName} IS {MessageContent} */
+    KIND_BYE      /**< BYE */
+};
+
+/**
+* @brief Fields of a parsed server message
+*
+* All views point into the parsed line and are valid as long as the line is.
+*/
+struct ServerMessage {
+    MessageKind kind; /**< Kind of the message */
+    std::string_view displayName; /**< Display name (MSG and ERR) */
+    std::string_view content; /**< Message content (REPLY, MSG and ERR) */
+    bool replyOk; /**< Result of the REPLY, true for OK */
+    uint16_t refMessageID; /**< ID of the answered message (REPLY, UDP only) */
+};
+
+/**
+* @brief Parses one server message of the TCP text grammar.
+*
+* The line is scanned once from left to right, keywords are matched case-insensitively
+* and words are separated by a single space. Nothing is allocated, all fields of
+* @p message are views into @p line.
+*
+* @param line One message without the terminating CRLF.
+* @param message Output structure with the parsed fields.
+* @return true if the line matches the grammar, false otherwise (kind is KIND_INVALID).
+*/
+bool parseServerMessage(std::string_view line, ServerMessage &message);
+
+#endif /* PARSER_HPP */
@@ -0,0 +1,61 @@
+#include "pool.hpp"
+#include <string.h>
+
+using namespace std;
+
+void PacketBuffer::header(unsigned char type, int messageID){
+    data[0] = type;
+    data[1] = (messageID >> 8) & 0xFF;
+    data[2] = messageID & 0xFF;
+    length = 3;
+}
+
+bool PacketBuffer::field(string_view field){
+    if (length + field.size() + 1 > CAPACITY) {
+        return false;
+    }
+    memcpy(data + length, field.data(), field.size());
+    length += field.size();
+    data[length++] = 0;
+    return true;
+}
+
+bool PacketBuffer::byte(unsigned char value){
+    if (length >= CAPACITY) {
+        return false;
+    }
+    data[length++] = value;
+    return true;
+}
+
+BufferPool::BufferPool() : freeList(nullptr) {
+    grow();
+}
+
+PacketBuffer* BufferPool::acquire(){
+    if (freeList == nullptr) {
+        grow();
+    }
+    PacketBuffer* buffer = freeList;
+    freeList = buffer->next;
+    buffer->length = 0;
+    buffer->next = nullptr;
+    return buffer;
+}
+
+void BufferPool::release(PacketBuffer* buffer){
+    if (buffer == nullptr) {
+        return;
+    }
+    buffer->next = freeList;
+    freeList = buffer;
+}
+
+void BufferPool::grow(){
+    unique_ptr<PacketBuffer[]> block(new PacketBuffer[BLOCK]);
+    for (size_t i = 0; i < BLOCK; ++i) {
+        block[i].next = freeList;
+        freeList = &block[i];
+    }
+    blocks.push_back(move(block));
+}
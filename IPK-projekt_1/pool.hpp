@@ -0,0 +1,84 @@
+/**
+* @file pool.hpp
+* @brief Header file for the BufferPool class
+*/
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+* @brief Fixed-capacity buffer holding one encoded UDP datagram
+*/
+struct PacketBuffer {
+    static const size_t CAPACITY = 1500; /**< Maximum datagram size */
+    unsigned char data[CAPACITY]; /**< Encoded message */
+    size_t length; /**< Number of used bytes */
+    PacketBuffer* next; /**< Next buffer in the free list */
+
+    /**
+    * @brief Starts a new message with its type and 2-byte message ID.
+    * @param type Message type.
+    * @param messageID Message ID (written in network byte order).
+    */
+    void header(unsigned char type, int messageID);
+
+    /**
+    * @brief Appends a string field terminated by a zero byte.
+    * @param field Content of the field.
+    * @return false if the field does not fit into the buffer.
+    */
+    bool field(std::string_view field);
+
+    /**
+    * @brief Appends a single byte.
+    * @param value The byte.
+    * @return false if the buffer is full.
+    */
+    bool byte(unsigned char value);
+};
+
+/**
+* @class BufferPool
+* @brief Free list of preallocated PacketBuffers
+*
+* Buffers are allocated in blocks and never freed while the pool exists, so
+* once the pool has grown to the number of messages in flight, taking and
+* returning a buffer does not touch the heap.
+*/
+class BufferPool {
+public:
+    static const size_t BLOCK = 64; /**< Number of buffers allocated at once */
+
+    /**
+    * @brief Constructor for the BufferPool class, preallocates one block
+    */
+    BufferPool();
+
+    /**
+    * @brief Takes a buffer from the free list, allocates a new block if the list is empty.
+    * @return Empty buffer.
+    */
+    PacketBuffer* acquire();
+
+    /**
+    * @brief Returns the buffer to the free list.
+    * @param buffer Buffer taken by acquire (nullptr is ignored).
+    */
+    void release(PacketBuffer* buffer);
+
+private:
+    /**
+    * @brief Allocates a block of buffers and puts them into the free list.
+    */
+    void grow();
+
+    std::vector<std::unique_ptr<PacketBuffer[]>> blocks; /**< Owned storage */
+    PacketBuffer* freeList; /**< Buffers ready to be taken */
+};
+
+#endif /* POOL_HPP */
@@ -0,0 +1,218 @@
+#include "reactor.hpp"
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+using namespace std;
+
+Reactor::Reactor() : timerFd(-1), signalFd(-1), running(false) {
+    sigemptyset(&signals);
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        recordFailure("epoll_create1");
+        return;
+    }
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerFd < 0) {
+        recordFailure("timerfd_create");
+        return;
+    }
+
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = timerFd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &event) < 0) {
+        recordFailure("epoll_ctl");
+    }
+}
+
+Reactor::~Reactor() {
+    if (signalFd != -1) {
+        close(signalFd);
+    }
+    if (timerFd != -1) {
+        close(timerFd);
+    }
+    if (epollFd != -1) {
+        close(epollFd);
+    }
+}
+
+void Reactor::recordFailure(const char *call) {
+    // Only the first failure is reported, the later ones are its consequences
+    if (failureMessage.empty()) {
+        failureMessage = string(call) + "() failed: " + strerror(errno);
+    }
+}
+
+bool Reactor::add(int fd, uint32_t events, Handler handler) {
+    struct epoll_event event = {};
+    event.events = events;
+    event.data.fd = fd;
+    bool alwaysReadyFd = false;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        // Regular files are always readable and epoll refuses them
+        if (errno != EPERM) {
+            return false;
+        }
+        alwaysReadyFd = true;
+        alwaysReady.push_back(fd);
+    }
+    watches[fd] = Watch{handler, true, alwaysReadyFd};
+    return true;
+}
+
+bool Reactor::modify(int fd, uint32_t events) {
+    auto it = watches.find(fd);
+    if (it == watches.end() || !it->second.active || it->second.alwaysReady) {
+        return false;
+    }
+    struct epoll_event event = {};
+    event.events = events;
+    event.data.fd = fd;
+    return epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event) == 0;
+}
+
+void Reactor::remove(int fd) {
+    auto it = watches.find(fd);
+    if (it == watches.end() || !it->second.active) {
+        return;
+    }
+    it->second.active = false;
+    if (it->second.alwaysReady) {
+        alwaysReady.erase(std::remove(alwaysReady.begin(), alwaysReady.end(), fd), alwaysReady.end());
+    } else {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+}
+
+bool Reactor::watching(int fd) const {
+    auto it = watches.find(fd);
+    return it != watches.end() && it->second.active;
+}
+
+void Reactor::onTimer(function<void()> handler) {
+    timerHandler = handler;
+}
+
+bool Reactor::onSignal(int signum, function<void()> handler) {
+    sigaddset(&signals, signum);
+    if (sigprocmask(SIG_BLOCK, &signals, nullptr) < 0) {
+        recordFailure("sigprocmask");
+        return false;
+    }
+    bool created = signalFd == -1;
+    // An existing signalfd only gets the new mask
+    int fd = signalfd(signalFd, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0) {
+        recordFailure("signalfd");
+        return false;
+    }
+    signalFd = fd;
+    if (created) {
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = signalFd;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, signalFd, &event) < 0) {
+            recordFailure("epoll_ctl");
+            close(signalFd);
+            signalFd = -1;
+            return false;
+        }
+    }
+    signalHandlers[signum] = handler;
+    return true;
+}
+
+void Reactor::onPrepare(function<int()> prepare) {
+    this->prepare = prepare;
+}
+
+bool Reactor::armTimer(int timeoutMs) {
+    struct itimerspec spec = {};
+    if (timeoutMs == 0) {
+        // Zero would disarm the timer, expire as soon as possible instead
+        spec.it_value.tv_nsec = 1;
+    } else if (timeoutMs > 0) {
+        spec.it_value.tv_sec = timeoutMs / 1000;
+        spec.it_value.tv_nsec = (timeoutMs % 1000) * 1000000L;
+    }
+    return timerfd_settime(timerFd, 0, &spec, nullptr) == 0;
+}
+
+void Reactor::dispatch(int fd, uint32_t events) {
+    auto it = watches.find(fd);
+    if (it != watches.end() && it->second.active) {
+        it->second.handler(events);
+    }
+}
+
+bool Reactor::run() {
+    const int MAX_EVENTS = 16;
+    struct epoll_event events[MAX_EVENTS];
+    if (!failureMessage.empty()) {
+        return false;
+    }
+    running = true;
+    while (running) {
+        int timeout = prepare ? prepare() : -1;
+        if (!running) {
+            break;
+        }
+        if (!armTimer(timeout)) {
+            recordFailure("timerfd_settime");
+            return false;
+        }
+
+        int ready = epoll_wait(epollFd, events, MAX_EVENTS, alwaysReady.empty() ? -1 : 0);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            recordFailure("epoll_wait");
+            return false;
+        }
+        for (int i = 0; i < ready && running; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == timerFd) {
+                uint64_t expirations;
+                if (read(timerFd, &expirations, sizeof(expirations)) > 0 && timerHandler) {
+                    timerHandler();
+                }
+            } else if (fd == signalFd) {
+                struct signalfd_siginfo info;
+                while (read(signalFd, &info, sizeof(info)) == sizeof(info)) {
+                    auto handler = signalHandlers.find(info.ssi_signo);
+                    if (handler != signalHandlers.end()) {
+                        handler->second();
+                    }
+                }
+            } else {
+                dispatch(fd, events[i].events);
+            }
+        }
+        for (size_t i = 0; i < alwaysReady.size() && running; ++i) {
+            dispatch(alwaysReady[i], EPOLLIN);
+        }
+        // Removed descriptors are forgotten only now, their callbacks may have been running
+        for (auto it = watches.begin(); it != watches.end();) {
+            if (!it->second.active) {
+                it = watches.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    return true;
+}
+
+const string& Reactor::failure() const {
+    return failureMessage;
+}
+
+void Reactor::stop() {
+    running = false;
+}
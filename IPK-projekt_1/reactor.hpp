@@ -0,0 +1,165 @@
+/**
+* @file reactor.hpp
+* @brief Header file for the Reactor class
+*/
+#ifndef REACTOR_HPP
+#define REACTOR_HPP
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <signal.h>
+#include <sys/epoll.h>
+
+/**
+* @class Reactor
+* @brief Event loop built on epoll
+*
+* File descriptors are registered together with a callback which is called
+* with the epoll events. Deadlines are delivered through a timerfd and
+* signals through a signalfd, so their handlers run in the normal flow of
+* the program and not in signal context. Before every wait the prepare
+* callback returns the time to the next deadline and the timer is armed
+* with it.
+*
+* A failed system call of the setup (constructor, onSignal) is remembered
+* and run then returns false without waiting. The reactor prints nothing,
+* the caller reports failure where its other output goes.
+*
+* File descriptors that epoll cannot watch (stdin redirected from a regular
+* file) are always ready, their callback is called in every iteration.
+*/
+class Reactor {
+public:
+    typedef std::function<void(uint32_t events)> Handler;
+
+    /**
+    * @brief Constructor for the Reactor class, creates the epoll instance and the timerfd
+    */
+    Reactor();
+
+    /**
+    * @brief Destructor for the Reactor class, closes the descriptors of the reactor
+    */
+    ~Reactor();
+
+    /**
+    * @brief Registers a file descriptor.
+    * @param fd File descriptor to watch.
+    * @param events Epoll events (EPOLLIN, ...).
+    * @param handler Callback called with the ready events.
+    * @return false if the descriptor cannot be registered.
+    */
+    bool add(int fd, uint32_t events, Handler handler);
+
+    /**
+    * @brief Changes the events of a registered file descriptor, the handler stays.
+    * @param fd Registered file descriptor.
+    * @param events Epoll events (EPOLLIN, EPOLLOUT, ...).
+    * @return false if the descriptor is not registered or epoll refuses the change.
+    */
+    bool modify(int fd, uint32_t events);
+
+    /**
+    * @brief Unregisters a file descriptor, it may be called from its own callback.
+    * @param fd Registered file descriptor.
+    */
+    void remove(int fd);
+
+    /**
+    * @brief Checks if a file descriptor is registered.
+    * @param fd File descriptor.
+    * @return true if fd is watched.
+    */
+    bool watching(int fd) const;
+
+    /**
+    * @brief Sets the callback called when the deadline from prepare passes.
+    * @param handler Timer callback.
+    */
+    void onTimer(std::function<void()> handler);
+
+    /**
+    * @brief Delivers the signal through a signalfd instead of a signal handler.
+    *
+    * The signal is blocked for the whole process, the callback is called from run.
+    *
+    * @param signum Signal number.
+    * @param handler Callback called when the signal arrives.
+    * @return false if the signal cannot be blocked or the signalfd cannot be created or registered, run then fails too.
+    */
+    bool onSignal(int signum, std::function<void()> handler);
+
+    /**
+    * @brief Sets the callback called before every wait.
+    *
+    * It returns the number of milliseconds to the next deadline (-1 if there is none)
+    * and may stop the reactor.
+    *
+    * @param prepare Prepare callback.
+    */
+    void onPrepare(std::function<int()> prepare);
+
+    /**
+    * @brief Runs the event loop until stop is called or waiting fails.
+    * @return false if the setup, arming the timer or epoll_wait failed, true otherwise.
+    */
+    bool run();
+
+    /**
+    * @brief Describes why run returned false.
+    * @return "call() failed: reason" of the first failed system call, empty if none.
+    */
+    const std::string& failure() const;
+
+    /**
+    * @brief Stops the event loop after the current callback returns.
+    */
+    void stop();
+
+private:
+    /**
+    * @brief Arms the timerfd.
+    * @param timeoutMs Milliseconds from now, -1 disarms the timer.
+    * @return false if timerfd_settime failed.
+    */
+    bool armTimer(int timeoutMs);
+
+    /**
+    * @brief Remembers the first failed system call for run and failure.
+    * @param call Name of the system call, errno holds the reason.
+    */
+    void recordFailure(const char *call);
+
+    /**
+    * @brief Calls the callback of a registered descriptor.
+    * @param fd File descriptor.
+    * @param events Ready events.
+    */
+    void dispatch(int fd, uint32_t events);
+
+    /**
+    * @brief Registered descriptor
+    */
+    struct Watch {
+        Handler handler; /**< Callback */
+        bool active; /**< Not removed yet */
+        bool alwaysReady; /**< Not watched by epoll */
+    };
+
+    int epollFd; /**< Epoll instance */
+    int timerFd; /**< Timer of the next deadline */
+    int signalFd; /**< Signals delivered as events, -1 if none */
+    sigset_t signals; /**< Signals handled by signalFd */
+    std::string failureMessage; /**< First failed system call and its reason, empty if none */
+    std::map<int, Watch> watches; /**< Registered descriptors */
+    std::vector<int> alwaysReady; /**< Descriptors epoll cannot watch */
+    std::map<int, std::function<void()>> signalHandlers; /**< Callbacks of signals */
+    std::function<void()> timerHandler; /**< Callback of the timer */
+    std::function<int()> prepare; /**< Callback computing the next deadline */
+    bool running; /**< The loop should continue */
+};
+
+#endif /* REACTOR_HPP */
@@ -0,0 +1,171 @@
+#include "receiver.hpp"
+#include <errno.h>
+#include <string.h>
+
+using namespace std;
+
+DatagramReceiver::DatagramReceiver() : batches(0), datagrams(0), largestBatch(0), fullBatches(0)
+#ifdef USE_IO_URING
+    , ringActive(false), heldCount(0)
+#endif
+{
+    memset(headers, 0, sizeof(headers));
+    for (int i = 0; i < BATCH; ++i) {
+        iovecs[i].iov_base = buffers[i];
+        iovecs[i].iov_len = SIZE;
+        headers[i].msg_hdr.msg_iov = &iovecs[i];
+        headers[i].msg_hdr.msg_iovlen = 1;
+        headers[i].msg_hdr.msg_name = &addresses[i];
+    }
+}
+
+int DatagramReceiver::watchFd(int sock){
+#ifdef USE_IO_URING
+    if (!ringActive && ring.init(8, 2 * RING_BUFFERS) && ring.registerBuffers(GROUP, ringBuffers[0], RING_BUFFERS, SIZE + 1, SIZE)
+        && armRing(sock)) {
+        ringActive = true;
+    }
+    if (ringActive) {
+        return ring.fd();
+    }
+#endif
+    return sock;
+}
+
+const char* DatagramReceiver::backend() const {
+#ifdef USE_IO_URING
+    if (ringActive) {
+        return "io_uring";
+    }
+#endif
+    return "recvmmsg";
+}
+
+#ifdef USE_IO_URING
+bool DatagramReceiver::armRing(int sock){
+    struct io_uring_sqe *sqe = ring.getSqe();
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = sock;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = GROUP;
+    return ring.submit() >= 0;
+}
+
+int DatagramReceiver::drainRing(int sock){
+    // The previous batch has been processed, its buffers go back to the kernel
+    for (int i = 0; i < heldCount; ++i) {
+        ring.recycleBuffer(held[i]);
+    }
+    if (heldCount > 0) {
+        ring.commitBuffers();
+    }
+    heldCount = 0;
+
+    int received = 0;
+    bool failed = false;
+    bool rearm = false;
+    struct io_uring_cqe cqe;
+    while (received < BATCH && ring.peek(cqe)) {
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            // The multishot receive ended (out of buffers or an error)
+            rearm = true;
+        }
+        if (cqe.res < 0) {
+            if (cqe.res != -ENOBUFS) {
+                failed = true;
+            }
+            continue;
+        }
+        if (!(cqe.flags & IORING_CQE_F_BUFFER)) {
+            continue;
+        }
+        uint16_t id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+        held[heldCount++] = id;
+        ringBuffers[id][cqe.res] = '\0';
+        ringData[received] = ringBuffers[id];
+        ringLengths[received] = cqe.res;
+        ++received;
+    }
+    if (rearm && !armRing(sock)) {
+        failed = true;
+    }
+    if (failed && received == 0) {
+        return -1;
+    }
+    return received;
+}
+#endif
+
+int DatagramReceiver::drain(int sock){
+#ifdef USE_IO_URING
+    if (ringActive) {
+        int received = drainRing(sock);
+        if (received > 0) {
+            ++batches;
+            datagrams += received;
+            if (received > largestBatch) {
+                largestBatch = received;
+            }
+            if (received == BATCH) {
+                ++fullBatches;
+            }
+        }
+        return received;
+    }
+#endif
+    for (int i = 0; i < BATCH; ++i) {
+        headers[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+    }
+    int received = recvmmsg(sock, headers, BATCH, MSG_DONTWAIT, nullptr);
+    if (received < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+        return -1;
+    }
+    for (int i = 0; i < received; ++i) {
+        buffers[i][headers[i].msg_len] = '\0';
+    }
+    if (received > 0) {
+        ++batches;
+        datagrams += received;
+        if (received > largestBatch) {
+            largestBatch = received;
+        }
+        if (received == BATCH) {
+            ++fullBatches;
+        }
+    }
+    return received;
+}
+
+char* DatagramReceiver::data(int index){
+#ifdef USE_IO_URING
+    if (ringActive) {
+        return ringData[index];
+    }
+#endif
+    return buffers[index];
+}
+
+size_t DatagramReceiver::length(int index) const {
+#ifdef USE_IO_URING
+    if (ringActive) {
+        return ringLengths[index];
+    }
+#endif
+    return headers[index].msg_len;
+}
+
+void DatagramReceiver::printStats(ostream &out) const {
+    out << "Received " << datagrams << " datagrams in " << batches << " batches";
+    if (batches > 0) {
+        out << " (average " << static_cast<double>(datagrams) / batches << ", largest " << largestBatch
+            << ", full " << fullBatches << ")";
+    }
+    out << " via " << backend() << endl;
+}
@@ -0,0 +1,124 @@
+/**
+* @file receiver.hpp
+* @brief Header file for the DatagramReceiver class
+*/
+#ifndef RECEIVER_HPP
+#define RECEIVER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#ifdef USE_IO_URING
+#include "uring.hpp"
+#endif
+
+/**
+* @class DatagramReceiver
+* @brief Receives a batch of datagrams with one recvmmsg call
+*
+* Datagrams are received into preallocated buffers reused by every batch, each buffer has
+* one spare byte so the datagram can be terminated by a zero byte.
+*
+* Built with USE_IO_URING (make IO_URING=1), watchFd arms a multishot receive with
+* provided buffers instead, and drain only collects its completions. If the kernel does
+* not support it, recvmmsg is used.
+*/
+class DatagramReceiver {
+public:
+    static const int BATCH = 32; /**< Maximum number of datagrams received at once */
+    static const size_t SIZE = 1500; /**< Maximum size of one datagram */
+
+    /**
+    * @brief Constructor for the DatagramReceiver class
+    */
+    DatagramReceiver();
+
+    /**
+    * @brief Descriptor the event loop waits on before calling drain.
+    *
+    * With the io_uring backend the multishot receive is armed on the socket and the ring
+    * descriptor is returned, otherwise the socket itself.
+    *
+    * @param sock The socket to read from.
+    * @return Descriptor that becomes readable when datagrams are waiting.
+    */
+    int watchFd(int sock);
+
+    /**
+    * @brief Name of the backend in use.
+    * @return "io_uring" or "recvmmsg".
+    */
+    const char* backend() const;
+
+    /**
+    * @brief Receives all datagrams waiting in the socket, at most BATCH.
+    *
+    * Does not block, every received datagram is terminated by a zero byte.
+    *
+    * @param sock The socket to read from.
+    * @return Number of received datagrams (0 if there are none), -1 on error.
+    */
+    int drain(int sock);
+
+    /**
+    * @brief Data of a datagram from the last batch.
+    * @param index Index in the batch.
+    * @return Pointer to the received bytes.
+    */
+    char* data(int index);
+
+    /**
+    * @brief Length of a datagram from the last batch.
+    * @param index Index in the batch.
+    * @return Number of received bytes.
+    */
+    size_t length(int index) const;
+
+    /**
+    * @brief Writes the batch size statistics.
+    * @param out Output stream.
+    */
+    void printStats(std::ostream &out) const;
+
+    uint64_t batches; /**< Number of non-empty batches */
+    uint64_t datagrams; /**< Number of received datagrams */
+    int largestBatch; /**< Largest number of datagrams received at once */
+    uint64_t fullBatches; /**< Number of batches that filled all buffers */
+
+private:
+    char buffers[BATCH][SIZE + 1]; /**< Preallocated buffers */
+    struct iovec iovecs[BATCH]; /**< Buffer descriptors for recvmmsg */
+    struct mmsghdr headers[BATCH]; /**< Message headers for recvmmsg */
+    struct sockaddr_in addresses[BATCH]; /**< Source addresses */
+
+#ifdef USE_IO_URING
+    static const unsigned RING_BUFFERS = 64; /**< Number of provided buffers */
+    static const uint16_t GROUP = 0; /**< Buffer group of the provided buffers */
+
+    /**
+    * @brief Submits the multishot receive.
+    * @param sock The socket to read from.
+    * @return false if submitting failed.
+    */
+    bool armRing(int sock);
+
+    /**
+    * @brief Collects the completions of the multishot receive, at most BATCH.
+    * @param sock The socket, the receive is armed again on it when it ends.
+    * @return Number of received datagrams, -1 on error.
+    */
+    int drainRing(int sock);
+
+    Uring ring; /**< Ring of the multishot receive */
+    bool ringActive; /**< The io_uring backend is in use */
+    char ringBuffers[RING_BUFFERS][SIZE + 1]; /**< Provided buffers */
+    char* ringData[BATCH]; /**< Datagrams of the last batch */
+    size_t ringLengths[BATCH]; /**< Lengths of the datagrams of the last batch */
+    uint16_t held[BATCH]; /**< Provided buffers used by the last batch */
+    int heldCount; /**< Number of held buffers */
+#endif
+};
+
+#endif /* RECEIVER_HPP */
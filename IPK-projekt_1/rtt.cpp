@@ -0,0 +1,48 @@
+#include "rtt.hpp"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+RttEstimator::RttEstimator(int initialMs){
+    reset(initialMs);
+}
+
+void RttEstimator::reset(int initialMs){
+    srtt = 0;
+    rttvar = 0;
+    rto = max(initialMs, MIN_TIMEOUT_MS) * 1000.0;
+    maxRto = rto * MAX_FACTOR;
+    samples = 0;
+}
+
+void RttEstimator::sample(Duration rtt){
+    double measured = static_cast<double>(rtt.count());
+    if (samples == 0) {
+        srtt = measured;
+        rttvar = measured / 2;
+    } else {
+        rttvar = 0.75 * rttvar + 0.25 * fabs(srtt - measured);
+        srtt = 0.875 * srtt + 0.125 * measured;
+    }
+    ++samples;
+    // Clock granularity of 1 ms
+    rto = srtt + max(1000.0, 4 * rttvar);
+    rto = min(max(rto, MIN_TIMEOUT_MS * 1000.0), maxRto);
+}
+
+RttEstimator::Duration RttEstimator::timeout(int attempt) const {
+    double backedOff = rto;
+    for (int i = 0; i < attempt && backedOff < maxRto; ++i) {
+        backedOff *= 2;
+    }
+    return Duration(static_cast<long>(min(backedOff, maxRto)));
+}
+
+void RttEstimator::printStats(ostream &out) const {
+    out << "RTT samples " << samples;
+    if (samples > 0) {
+        out << ", smoothed " << srtt / 1000 << " ms, variance " << rttvar / 1000 << " ms";
+    }
+    out << ", timeout " << rto / 1000 << " ms" << endl;
+}
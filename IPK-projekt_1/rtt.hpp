@@ -0,0 +1,67 @@
+/**
+* @file rtt.hpp
+* @brief Header file for the RttEstimator class
+*/
+#ifndef RTT_HPP
+#define RTT_HPP
+
+#include <chrono>
+#include <ostream>
+
+/**
+* @class RttEstimator
+* @brief Retransmission timeout computed from measured round trip times
+*
+* Follows RFC 6298: the smoothed RTT and its variance are updated from every
+* CONFIRM of a message that was sent only once (Karn's rule, a CONFIRM of a
+* retransmitted message cannot be matched to one transmission). Until the
+* first sample the timeout is the configured initial value. The timeout is
+* doubled for every retransmission of the same message.
+*/
+class RttEstimator {
+public:
+    typedef std::chrono::microseconds Duration;
+
+    static constexpr int MIN_TIMEOUT_MS = 10; /**< Lower bound of the timeout */
+    static constexpr int MAX_FACTOR = 4; /**< Upper bound of the timeout as a multiple of the initial value */
+
+    /**
+    * @brief Constructor for the RttEstimator class
+    * @param initialMs Timeout before the first sample in milliseconds (-d).
+    */
+    RttEstimator(int initialMs = 250);
+
+    /**
+    * @brief Sets the timeout used before the first sample and resets the estimate.
+    * @param initialMs Timeout in milliseconds.
+    */
+    void reset(int initialMs);
+
+    /**
+    * @brief Adds a measured round trip time.
+    * @param rtt Time between sending a message and receiving its CONFIRM.
+    */
+    void sample(Duration rtt);
+
+    /**
+    * @brief Timeout for the given attempt of a message.
+    * @param attempt Number of retransmissions done so far (0 for the first transmission).
+    * @return Time to wait for the CONFIRM.
+    */
+    Duration timeout(int attempt) const;
+
+    /**
+    * @brief Writes the current estimate.
+    * @param out Output stream.
+    */
+    void printStats(std::ostream &out) const;
+
+private:
+    double srtt; /**< Smoothed RTT in microseconds */
+    double rttvar; /**< RTT variance in microseconds */
+    double rto; /**< Current timeout in microseconds */
+    double maxRto; /**< Upper bound of the timeout in microseconds */
+    long samples; /**< Number of samples */
+};
+
+#endif /* RTT_HPP */
@@ -0,0 +1,208 @@
+#include "scan.hpp"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+static const char* levelNames[] = {"scalar", "sse2", "avx2"};
+
+static const char* findByteScalar(const char* begin, const char* end, char byte){
+    for (; begin < end; ++begin) {
+        if (*begin == byte) {
+            return begin;
+        }
+    }
+    return end;
+}
+
+static const char* findCRLFScalar(const char* begin, const char* end){
+    for (; end - begin >= 2; ++begin) {
+        if (begin[0] == '\r' && begin[1] == '\n') {
+            return begin;
+        }
+    }
+    return end;
+}
+
+static bool bytesInRangeScalar(const char* begin, const char* end, unsigned char low, unsigned char high){
+    // Values below low wrap around above the width of the range
+    unsigned char width = high - low;
+    bool allowed = true;
+    for (; begin < end; ++begin) {
+        allowed &= static_cast<unsigned char>(*begin - low) <= width;
+    }
+    return allowed;
+}
+
+#if defined(__SSE2__)
+
+static const char* findByteSSE2(const char* begin, const char* end, char byte){
+    const __m128i needle = _mm_set1_epi8(byte);
+    for (; end - begin >= 16; begin += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+        int found = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+        if (found != 0) {
+            return begin + __builtin_ctz(found);
+        }
+    }
+    return findByteScalar(begin, end, byte);
+}
+
+static const char* findCRLFSSE2(const char* begin, const char* end){
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    // The LF of the last CR in a block is the first byte of the second load
+    for (; end - begin >= 17; begin += 16) {
+        __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+        __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin + 1));
+        int found = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, cr), _mm_cmpeq_epi8(second, lf)));
+        if (found != 0) {
+            return begin + __builtin_ctz(found);
+        }
+    }
+    return findCRLFScalar(begin, end);
+}
+
+static bool bytesInRangeSSE2(const char* begin, const char* end, unsigned char low, unsigned char high){
+    const __m128i offset = _mm_set1_epi8(static_cast<char>(low));
+    const __m128i width = _mm_set1_epi8(static_cast<char>(high - low));
+    __m128i allowed = _mm_set1_epi8(-1);
+    for (; end - begin >= 16; begin += 16) {
+        __m128i shifted = _mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(begin)), offset);
+        // shifted <= width as unsigned bytes
+        allowed = _mm_and_si128(allowed, _mm_cmpeq_epi8(_mm_min_epu8(shifted, width), shifted));
+    }
+    return _mm_movemask_epi8(allowed) == 0xFFFF && bytesInRangeScalar(begin, end, low, high);
+}
+
+// The AVX2 functions hand short ranges to SSE2 before touching a ymm register and
+// finish long ones with a last block overlapping the previous one, mixing in
+// legacy SSE code with dirty upper halves would stall on every instruction
+
+__attribute__((target("avx2")))
+static const char* findByteAVX2(const char* begin, const char* end, char byte){
+    if (end - begin < 32) {
+        return findByteSSE2(begin, end, byte);
+    }
+    const __m256i needle = _mm256_set1_epi8(byte);
+    const char* last = end - 32;
+    while (true) {
+        const char* block = begin < last ? begin : last;
+        unsigned found = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(block)), needle));
+        if (found != 0) {
+            return block + __builtin_ctz(found);
+        }
+        if (block == last) {
+            return end;
+        }
+        begin += 32;
+    }
+}
+
+__attribute__((target("avx2")))
+static const char* findCRLFAVX2(const char* begin, const char* end){
+    if (end - begin < 33) {
+        return findCRLFSSE2(begin, end);
+    }
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    // The LF of the last CR in a block is the last byte of the second load
+    const char* last = end - 33;
+    while (true) {
+        const char* block = begin < last ? begin : last;
+        __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+        __m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 1));
+        unsigned found = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, cr), _mm256_cmpeq_epi8(second, lf)));
+        if (found != 0) {
+            return block + __builtin_ctz(found);
+        }
+        if (block == last) {
+            return end;
+        }
+        begin += 32;
+    }
+}
+
+__attribute__((target("avx2")))
+static bool bytesInRangeAVX2(const char* begin, const char* end, unsigned char low, unsigned char high){
+    if (end - begin < 32) {
+        return bytesInRangeSSE2(begin, end, low, high);
+    }
+    const __m256i offset = _mm256_set1_epi8(static_cast<char>(low));
+    const __m256i width = _mm256_set1_epi8(static_cast<char>(high - low));
+    __m256i allowed = _mm256_set1_epi8(-1);
+    const char* last = end - 32;
+    for (; begin < last; begin += 32) {
+        __m256i shifted = _mm256_sub_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin)), offset);
+        allowed = _mm256_and_si256(allowed, _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, width), shifted));
+    }
+    __m256i shifted = _mm256_sub_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(last)), offset);
+    allowed = _mm256_and_si256(allowed, _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, width), shifted));
+    return _mm256_movemask_epi8(allowed) == -1;
+}
+
+#endif
+
+// Best level of this CPU
+static ScanLevel supportedLevel(){
+#if defined(__SSE2__)
+    // Runs before main, the CPU model may not be initialized yet
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? SCAN_AVX2 : SCAN_SSE2;
+#else
+    return SCAN_SCALAR;
+#endif
+}
+
+static ScanLevel currentLevel = supportedLevel();
+
+const char* findByte(const char* begin, const char* end, char byte){
+#if defined(__SSE2__)
+    if (currentLevel == SCAN_AVX2) {
+        return findByteAVX2(begin, end, byte);
+    }
+    if (currentLevel == SCAN_SSE2) {
+        return findByteSSE2(begin, end, byte);
+    }
+#endif
+    return findByteScalar(begin, end, byte);
+}
+
+const char* findCRLF(const char* begin, const char* end){
+#if defined(__SSE2__)
+    if (currentLevel == SCAN_AVX2) {
+        return findCRLFAVX2(begin, end);
+    }
+    if (currentLevel == SCAN_SSE2) {
+        return findCRLFSSE2(begin, end);
+    }
+#endif
+    return findCRLFScalar(begin, end);
+}
+
+bool bytesInRange(const char* begin, const char* end, unsigned char low, unsigned char high){
+#if defined(__SSE2__)
+    if (currentLevel == SCAN_AVX2) {
+        return bytesInRangeAVX2(begin, end, low, high);
+    }
+    if (currentLevel == SCAN_SSE2) {
+        return bytesInRangeSSE2(begin, end, low, high);
+    }
+#endif
+    return bytesInRangeScalar(begin, end, low, high);
+}
+
+ScanLevel scanLevel(){
+    return currentLevel;
+}
+
+void setScanLevel(ScanLevel level){
+    ScanLevel supported = supportedLevel();
+    currentLevel = level < supported ? level : supported;
+}
+
+const char* scanLevelName(ScanLevel level){
+    return levelNames[level];
+}
@@ -0,0 +1,69 @@
+/**
+* @file scan.hpp
+* @brief Header file for the vectorized scanning of received messages
+*
+* The field separators of both formats (NUL in UDP datagrams, space and CRLF
+* in TCP lines) and the printable ranges of the validated fields are checked
+* 32 bytes at a time with AVX2, 16 with SSE2, or byte by byte elsewhere. The
+* best level supported by the CPU is chosen at startup. Every function works
+* on the half-open range [begin, end) and never reads outside of it.
+*/
+#ifndef SCAN_HPP
+#define SCAN_HPP
+
+/**
+* @brief Instruction set used by the scanning functions
+*/
+enum ScanLevel {
+    SCAN_SCALAR, /**< One byte at a time */
+    SCAN_SSE2,   /**< 16 bytes at a time */
+    SCAN_AVX2    /**< 32 bytes at a time */
+};
+
+/**
+* @brief Finds the first occurrence of a byte.
+* @param begin Start of the range.
+* @param end End of the range.
+* @param byte The byte.
+* @return Pointer to the byte, end if it is not in the range.
+*/
+const char* findByte(const char* begin, const char* end, char byte);
+
+/**
+* @brief Finds the first CR immediately followed by LF.
+* @param begin Start of the range.
+* @param end End of the range.
+* @return Pointer to the CR, end if there is no CRLF in the range.
+*/
+const char* findCRLF(const char* begin, const char* end);
+
+/**
+* @brief Checks that every byte lies in a range of values.
+* @param begin Start of the range.
+* @param end End of the range.
+* @param low Lowest allowed value.
+* @param high Highest allowed value.
+* @return true if every byte is allowed, also for an empty range.
+*/
+bool bytesInRange(const char* begin, const char* end, unsigned char low, unsigned char high);
+
+/**
+* @brief Level chosen for this CPU.
+* @return The level in use.
+*/
+ScanLevel scanLevel();
+
+/**
+* @brief Switches the level, used by the benchmarks to compare the implementations.
+* @param level Requested level, lowered to the best one the CPU supports.
+*/
+void setScanLevel(ScanLevel level);
+
+/**
+* @brief Name of a level.
+* @param level The level.
+* @return scalar, sse2 or avx2.
+*/
+const char* scanLevelName(ScanLevel level);
+
+#endif /* SCAN_HPP */
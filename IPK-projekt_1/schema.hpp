@@ -0,0 +1,585 @@
+/**
+* @file schema.hpp
+* @brief Compile-time schema of the IPK24-CHAT messages for both transports
+*
+* Every message type is declared once as a MessageLayout: its kind, UDP type
+* code, TCP keyword and the list of its elements. The templates generate from
+* the list the encoder and decoder of the TCP text grammar and of the UDP
+* binary format, so adding a message type means adding one layout to a
+* schema. Decoders only take views into the received data, encoders write the
+* fields straight into the output buffer.
+*/
+#ifndef SCHEMA_HPP
+#define SCHEMA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include "parser.hpp"
+#include "pool.hpp"
+#include "scan.hpp"
+#include "session.hpp"
+
+/**
+* @brief Position in a TCP line being decoded
+*/
+struct TextReader {
+    std::string_view line; /**< The line without CRLF */
+    size_t pos; /**< Start of the next word */
+    bool separated; /**< The last word was followed by a space, so another element must follow */
+
+    /**
+    * @brief Takes the word starting at pos and the space behind it.
+    * @return The word, empty if there are two spaces in a row.
+    */
+    std::string_view word() {
+        const char* start = line.data() + pos;
+        const char* end = findByte(start, line.data() + line.size(), ' ');
+        pos = end - line.data();
+        separated = pos < line.size();
+        pos += separated;
+        return std::string_view(start, end - start);
+    }
+};
+
+/**
+* @brief Position in a UDP datagram being decoded
+*/
+struct DatagramReader {
+    const char* data; /**< The datagram */
+    size_t length; /**< Size of the datagram */
+    size_t pos; /**< Next unread byte */
+
+    /**
+    * @brief Takes a zero terminated field.
+    * @param field Output, the field without the terminator.
+    * @return false if there is no terminator within the datagram.
+    */
+    bool field(std::string_view &field) {
+        if (pos >= length) {
+            return false;
+        }
+        const char* start = data + pos;
+        const char* end = findByte(start, data + length, '\0');
+        if (end == data + length) {
+            return false;
+        }
+        field = std::string_view(start, end - start);
+        pos = end - data + 1;
+        return true;
+    }
+
+    /**
+    * @brief Takes one byte.
+    * @param value Output, the byte.
+    * @return false at the end of the datagram.
+    */
+    bool byte(uint8_t &value) {
+        if (pos >= length) {
+            return false;
+        }
+        value = static_cast<uint8_t>(data[pos++]);
+        return true;
+    }
+};
+
+/**
+* @brief Case-insensitive comparison of a word with an upper case keyword.
+* @tparam Upper The keyword.
+* @param word The word.
+* @return true if they match.
+*/
+template <const char* Upper>
+inline bool matchesKeyword(std::string_view word) {
+    constexpr size_t length = std::char_traits<char>::length(Upper);
+    if (word.size() != length) {
+        return false;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        if ((word[i] & ~0x20) != Upper[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+* @brief Copies a string into the output being written.
+* @param out Output position.
+* @param text The string.
+* @return Position after the string.
+*/
+inline char* putText(char* out, std::string_view text) {
+    memcpy(out, text.data(), text.size());
+    return out + text.size();
+}
+
+// Elements of a layout. Each one knows its size in the text grammar, how it is
+// written and read in both formats and how its member is cleared.
+
+/**
+* @brief Keyword of the text grammar between fields (AS, FROM, IS), not present in datagrams
+* @tparam Upper The keyword in upper case.
+*/
+template <const char* Upper>
+struct Keyword {
+    static constexpr bool endsLine = false; /**< Can be followed by further elements */
+    static constexpr size_t length = std::char_traits<char>::length(Upper); /**< Length of the keyword */
+
+    template <typename Message>
+    static size_t textLength(const Message&) {
+        return 1 + length;
+    }
+
+    template <typename Message>
+    static char* writeText(const Message&, char* out) {
+        *out = ' ';
+        memcpy(out + 1, Upper, length);
+        return out + 1 + length;
+    }
+
+    template <typename Message>
+    static bool readText(TextReader &reader, Message&) {
+        return reader.separated && matchesKeyword<Upper>(reader.word());
+    }
+
+    template <typename Message>
+    static void clear(Message&) {}
+
+    template <typename Message>
+    static bool writeDatagram(const Message&, PacketBuffer&) {
+        return true;
+    }
+
+    template <typename Message>
+    static bool readDatagram(DatagramReader&, Message&) {
+        return true;
+    }
+};
+
+/**
+* @brief Field that is one non-empty word in the text grammar and zero terminated in datagrams
+* @tparam Member The field, a string_view member of the message.
+*/
+template <auto Member>
+struct WordField {
+    static constexpr bool endsLine = false; /**< Can be followed by further elements */
+
+    template <typename Message>
+    static void clear(Message &message) {
+        message.*Member = std::string_view();
+    }
+
+    template <typename Message>
+    static size_t textLength(const Message &message) {
+        return 1 + (message.*Member).size();
+    }
+
+    template <typename Message>
+    static char* writeText(const Message &message, char* out) {
+        *out = ' ';
+        return putText(out + 1, message.*Member);
+    }
+
+    template <typename Message>
+    static bool readText(TextReader &reader, Message &message) {
+        if (!reader.separated) {
+            return false;
+        }
+        message.*Member = reader.word();
+        return !(message.*Member).empty();
+    }
+
+    template <typename Message>
+    static bool writeDatagram(const Message &message, PacketBuffer &out) {
+        return out.field(message.*Member);
+    }
+
+    template <typename Message>
+    static bool readDatagram(DatagramReader &reader, Message &message) {
+        return reader.field(message.*Member);
+    }
+};
+
+/**
+* @brief Field that takes the rest of the line in the text grammar and is zero terminated in datagrams
+* @tparam Member The field, a string_view member of the message.
+*/
+template <auto Member>
+struct ContentField {
+    static constexpr bool endsLine = true; /**< Must be the last element */
+
+    template <typename Message>
+    static void clear(Message &message) {
+        message.*Member = std::string_view();
+    }
+
+    template <typename Message>
+    static size_t textLength(const Message &message) {
+        return 1 + (message.*Member).size();
+    }
+
+    template <typename Message>
+    static char* writeText(const Message &message, char* out) {
+        *out = ' ';
+        return putText(out + 1, message.*Member);
+    }
+
+    template <typename Message>
+    static bool readText(TextReader &reader, Message &message) {
+        // The separator must be there even if the content is empty
+        if (!reader.separated) {
+            return false;
+        }
+        message.*Member = reader.line.substr(reader.pos);
+        reader.pos = reader.line.size();
+        reader.separated = false;
+        return true;
+    }
+
+    template <typename Message>
+    static bool writeDatagram(const Message &message, PacketBuffer &out) {
+        return out.field(message.*Member);
+    }
+
+    template <typename Message>
+    static bool readDatagram(DatagramReader &reader, Message &message) {
+        return reader.field(message.*Member);
+    }
+};
+
+inline constexpr char OK_WORD[] = "OK";
+inline constexpr char NOK_WORD[] = "NOK";
+
+/**
+* @brief Result of a REPLY, OK or NOK in the text grammar and one byte (1 or 0) in datagrams
+* @tparam Member The result, a bool member of the message.
+*/
+template <auto Member>
+struct ResultField {
+    static constexpr bool endsLine = false; /**< Can be followed by further elements */
+
+    template <typename Message>
+    static void clear(Message &message) {
+        message.*Member = false;
+    }
+
+    template <typename Message>
+    static size_t textLength(const Message &message) {
+        return message.*Member ? 3 : 4;
+    }
+
+    template <typename Message>
+    static char* writeText(const Message &message, char* out) {
+        return putText(out, message.*Member ? " OK" : " NOK");
+    }
+
+    template <typename Message>
+    static bool readText(TextReader &reader, Message &message) {
+        if (!reader.separated) {
+            return false;
+        }
+        std::string_view word = reader.word();
+        message.*Member = matchesKeyword<OK_WORD>(word);
+        return message.*Member || matchesKeyword<NOK_WORD>(word);
+    }
+
+    template <typename Message>
+    static bool writeDatagram(const Message &message, PacketBuffer &out) {
+        return out.byte(message.*Member ? 1 : 0);
+    }
+
+    template <typename Message>
+    static bool readDatagram(DatagramReader &reader, Message &message) {
+        uint8_t value;
+        if (!reader.byte(value)) {
+            return false;
+        }
+        message.*Member = value == 1;
+        return true;
+    }
+};
+
+/**
+* @brief ID of the answered message, two bytes in network byte order, only present in datagrams
+* @tparam Member The ID, a uint16_t member of the message.
+*/
+template <auto Member>
+struct ReferenceField {
+    static constexpr bool endsLine = false; /**< Can be followed by further elements */
+
+    template <typename Message>
+    static void clear(Message &message) {
+        message.*Member = 0;
+    }
+
+    template <typename Message>
+    static size_t textLength(const Message&) {
+        return 0;
+    }
+
+    template <typename Message>
+    static char* writeText(const Message&, char* out) {
+        return out;
+    }
+
+    template <typename Message>
+    static bool readText(TextReader&, Message&) {
+        return true;
+    }
+
+    template <typename Message>
+    static bool writeDatagram(const Message &message, PacketBuffer &out) {
+        return out.byte(message.*Member >> 8) && out.byte(message.*Member & 0xFF);
+    }
+
+    template <typename Message>
+    static bool readDatagram(DatagramReader &reader, Message &message) {
+        uint8_t high, low;
+        if (!reader.byte(high) || !reader.byte(low)) {
+            return false;
+        }
+        message.*Member = (high << 8) | low;
+        return true;
+    }
+};
+
+/**
+* @brief Checks that only the last element takes the rest of the line.
+* @return true if the order is valid.
+*/
+template <typename... Elements>
+constexpr bool validOrder() {
+    constexpr bool endsLine[] = {false, Elements::endsLine...};
+    for (size_t i = 1; i + 1 < sizeof(endsLine); ++i) {
+        if (endsLine[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+* @brief One message type, generates its encoders and decoders from the elements
+* @tparam Kind Value of the kind member of the message.
+* @tparam Code Type code of the datagram.
+* @tparam Name First word of the text grammar, in upper case.
+* @tparam Elements Elements after the name, in the order of the text grammar.
+*/
+template <auto Kind, uint8_t Code, const char* Name, typename... Elements>
+struct MessageLayout {
+    static_assert(validOrder<Elements...>(), "only the last element can take the rest of the line");
+
+    static constexpr auto kind = Kind; /**< Kind of the message */
+    static constexpr uint8_t code = Code; /**< Type code of the datagram */
+    static constexpr const char* name = Name; /**< First word of the line */
+    static constexpr size_t nameLength = std::char_traits<char>::length(Name); /**< Length of the name */
+
+    /**
+    * @brief Empties the members of the elements.
+    * @param message The message.
+    */
+    template <typename Message>
+    static void clear(Message &message) {
+        (Elements::clear(message), ...);
+    }
+
+    /**
+    * @brief Encodes the message in the text grammar, sized once and then copied.
+    * @param message The message.
+    * @param out Output, the line including CRLF.
+    */
+    template <typename Message>
+    static void encodeText(const Message &message, std::string &out) {
+        out.resize(nameLength + (Elements::textLength(message) + ... + 0) + 2);
+        char* position = putText(out.data(), std::string_view(Name, nameLength));
+        ((position = Elements::writeText(message, position)), ...);
+        position[0] = '\r';
+        position[1] = '\n';
+    }
+
+    /**
+    * @brief Encodes the message as a datagram.
+    * @param message The message.
+    * @param messageID ID written into the header.
+    * @param out Output buffer.
+    * @return false if the message does not fit into the buffer.
+    */
+    template <typename Message>
+    static bool encodeDatagram(const Message &message, int messageID, PacketBuffer &out) {
+        out.header(Code, messageID);
+        return (Elements::writeDatagram(message, out) && ...);
+    }
+
+    /**
+    * @brief Decodes the rest of a line whose first word was the name.
+    * @param reader Position after the name.
+    * @param message Output structure.
+    * @return true if the line matches, nothing may follow the last element.
+    */
+    template <typename Message>
+    static bool decodeText(TextReader &reader, Message &message) {
+        return (Elements::readText(reader, message) && ...) && !reader.separated;
+    }
+
+    /**
+    * @brief Decodes the fields of a datagram with this type code.
+    * @param reader Position after the header.
+    * @param message Output structure.
+    * @return true if every element is present.
+    */
+    template <typename Message>
+    static bool decodeDatagram(DatagramReader &reader, Message &message) {
+        return (Elements::readDatagram(reader, message) && ...);
+    }
+};
+
+/**
+* @brief Checks that no two layouts share a type code or a name.
+* @return true if both are unique.
+*/
+template <typename... Layouts>
+constexpr bool distinctLayouts() {
+    constexpr uint8_t codes[] = {Layouts::code...};
+    constexpr std::string_view names[] = {std::string_view(Layouts::name)...};
+    for (size_t i = 0; i < sizeof...(Layouts); ++i) {
+        for (size_t j = i + 1; j < sizeof...(Layouts); ++j) {
+            if (codes[i] == codes[j] || names[i] == names[j]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+* @brief All message types of one direction, dispatches on the kind, name or type code
+* @tparam Message Structure holding the fields, with a kind member.
+* @tparam Layouts The message types.
+*/
+template <typename Message, typename... Layouts>
+struct Schema {
+    static_assert(distinctLayouts<Layouts...>(), "two message types with the same type code or name");
+
+    /**
+    * @brief Empties every field and resets the kind, each member must belong to some layout.
+    *
+    * Member by member rather than assigning an empty message, whose copy the
+    * compiler splits into overlapping stores that the caller's loads cannot
+    * be forwarded from.
+    *
+    * @param message The message.
+    */
+    static void clear(Message &message) {
+        message.kind = Message{}.kind;
+        (Layouts::clear(message), ...);
+    }
+
+    /**
+    * @brief Encodes a message in the text grammar.
+    * @param message The message.
+    * @param out Output, replaced by the line including CRLF, its capacity is reused.
+    * @return false for a kind without a layout.
+    */
+    static bool encodeText(const Message &message, std::string &out) {
+        return ((message.kind == Layouts::kind && (Layouts::encodeText(message, out), true)) || ...);
+    }
+
+    /**
+    * @brief Encodes a message as a datagram.
+    * @param message The message.
+    * @param messageID ID written into the header.
+    * @param out Output buffer.
+    * @return false for a kind without a layout or a message that does not fit.
+    */
+    static bool encodeDatagram(const Message &message, int messageID, PacketBuffer &out) {
+        bool encoded = false;
+        ((message.kind == Layouts::kind && (encoded = Layouts::encodeDatagram(message, messageID, out), true)) || ...);
+        return encoded;
+    }
+
+    /**
+    * @brief Decodes one line of the text grammar, keywords are case-insensitive.
+    * @param line The line without CRLF.
+    * @param message Output structure, reset first, the views point into @p line.
+    * @return true if the line matches one of the layouts.
+    */
+    static bool decodeText(std::string_view line, Message &message) {
+        clear(message);
+        TextReader reader = {line, 0, false};
+        std::string_view first = reader.word();
+        bool decoded = false;
+        ((matchesKeyword<Layouts::name>(first) && (decoded = Layouts::decodeText(reader, message), message.kind = Layouts::kind, true)) || ...);
+        if (!decoded) {
+            clear(message);
+        }
+        return decoded;
+    }
+
+    /**
+    * @brief Decodes a datagram, the 3-byte header is not checked here.
+    * @param data The datagram, at least 3 bytes.
+    * @param length Size of the datagram.
+    * @param message Output structure, reset first, the views point into @p data.
+    * @return true if the type code is known and every field is present.
+    */
+    static bool decodeDatagram(const char* data, size_t length, Message &message) {
+        clear(message);
+        DatagramReader reader = {data, length, 3};
+        uint8_t code = static_cast<uint8_t>(data[0]);
+        bool decoded = false;
+        ((code == Layouts::code && (decoded = Layouts::decodeDatagram(reader, message), message.kind = Layouts::kind, true)) || ...);
+        if (!decoded) {
+            clear(message);
+        }
+        return decoded;
+    }
+};
+
+// The messages of IPK24-CHAT. MSG and ERR look the same in both directions.
+
+inline constexpr char AUTH_WORD[] = "AUTH";
+inline constexpr char JOIN_WORD[] = "JOIN";
+inline constexpr char MSG_WORD[] = "MSG";
+inline constexpr char ERR_WORD[] = "ERR";
+inline constexpr char BYE_WORD[] = "BYE";
+inline constexpr char REPLY_WORD[] = "REPLY";
+inline constexpr char AS_WORD[] = "AS";
+inline constexpr char USING_WORD[] = "USING";
+inline constexpr char FROM_WORD[] = "FROM";
+inline constexpr char IS_WORD[] = "IS";
+
+/**
+* @brief MSG and ERR: FROM {DisplayName} IS {MessageContent}, display name and content in datagrams
+*/
+template <typename Message, auto Kind, uint8_t Code, const char* Name>
+using ChatLayout = MessageLayout<Kind, Code, Name, Keyword<FROM_WORD>, WordField<&Message::displayName>,
+                                 Keyword<IS_WORD>, ContentField<&Message::content>>;
+
+/**
+* @brief Messages sent by the client
+*/
+typedef Schema<ClientMessage,
+    MessageLayout<CLIENT_AUTH, 0x02, AUTH_WORD, WordField<&ClientMessage::username>, Keyword<AS_WORD>,
+                  WordField<&ClientMessage::displayName>, Keyword<USING_WORD>, WordField<&ClientMessage::secret>>,
+    MessageLayout<CLIENT_JOIN, 0x03, JOIN_WORD, WordField<&ClientMessage::channelID>, Keyword<AS_WORD>,
+                  WordField<&ClientMessage::displayName>>,
+    ChatLayout<ClientMessage, CLIENT_MSG, 0x04, MSG_WORD>,
+    ChatLayout<ClientMessage, CLIENT_ERR, 0xFE, ERR_WORD>,
+    MessageLayout<CLIENT_BYE, 0xFF, BYE_WORD>
+> ClientSchema;
+
+/**
+* @brief Messages sent by the server, CONFIRM has no text form and is handled by the transport
+*/
+typedef Schema<ServerMessage,
+    MessageLayout<KIND_REPLY, 0x01, REPLY_WORD, ResultField<&ServerMessage::replyOk>,
+                  ReferenceField<&ServerMessage::refMessageID>, Keyword<IS_WORD>, ContentField<&ServerMessage::content>>,
+    ChatLayout<ServerMessage, KIND_MSG, 0x04, MSG_WORD>,
+    ChatLayout<ServerMessage, KIND_ERR, 0xFE, ERR_WORD>,
+    MessageLayout<KIND_BYE, 0xFF, BYE_WORD>
+> ServerSchema;
+
+#endif /* SCHEMA_HPP */
@@ -0,0 +1,111 @@
+#include "sender.hpp"
+#include <errno.h>
+#include <string.h>
+
+using namespace std;
+
+DatagramSender::DatagramSender() : calls(0), datagrams(0), count(0)
+#ifdef USE_IO_URING
+    , ringTried(false)
+#endif
+{
+    memset(headers, 0, sizeof(headers));
+    for (int i = 0; i < BATCH; ++i) {
+        headers[i].msg_hdr.msg_iov = &iovecs[i];
+        headers[i].msg_hdr.msg_iovlen = 1;
+        headers[i].msg_hdr.msg_name = &addresses[i];
+        headers[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+    }
+}
+
+void DatagramSender::queueConfirm(int sock, const struct sockaddr_in &address, int refMessageID){
+    if (count == BATCH) {
+        flush(sock);
+    }
+    //(confirm 0x00)
+    confirms[count][0] = 0x00;
+    confirms[count][1] = (refMessageID >> 8) & 0xFF;
+    confirms[count][2] = refMessageID & 0xFF;
+    queue(sock, address, confirms[count], sizeof(confirms[count]));
+}
+
+void DatagramSender::queue(int sock, const struct sockaddr_in &address, const unsigned char *data, size_t length){
+    if (count == BATCH) {
+        flush(sock);
+    }
+    addresses[count] = address;
+    iovecs[count].iov_base = const_cast<unsigned char*>(data);
+    iovecs[count].iov_len = length;
+    ++count;
+}
+
+#ifdef USE_IO_URING
+bool DatagramSender::flushRing(int sock){
+    for (int i = 0; i < count; ++i) {
+        // The ring has BATCH entries and is empty between flushes
+        struct io_uring_sqe *sqe = ring.getSqe();
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = sock;
+        sqe->addr = reinterpret_cast<uint64_t>(&headers[i].msg_hdr);
+        sqe->len = 1;
+    }
+    // The headers point to queued data, so all sends have to complete before returning
+    bool sent = ring.submit(count) == count;
+    ++calls;
+    struct io_uring_cqe cqe;
+    while (ring.peek(cqe)) {
+        if (cqe.res < 0) {
+            sent = false;
+        } else {
+            ++datagrams;
+        }
+    }
+    count = 0;
+    return sent;
+}
+#endif
+
+bool DatagramSender::flush(int sock){
+#ifdef USE_IO_URING
+    if (!ringTried) {
+        ringTried = true;
+        ring.init(BATCH);
+    }
+    if (ring.ready() && count > 0) {
+        return flushRing(sock);
+    }
+#endif
+    int sent = 0;
+    while (sent < count) {
+        int result = sendmmsg(sock, headers + sent, count - sent, 0);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            count = 0;
+            return false;
+        }
+        ++calls;
+        datagrams += result;
+        sent += result;
+    }
+    count = 0;
+    return true;
+}
+
+bool DatagramSender::empty() const {
+    return count == 0;
+}
+
+const char* DatagramSender::backend() const {
+#ifdef USE_IO_URING
+    if (ring.ready()) {
+        return "io_uring";
+    }
+#endif
+    return "sendmmsg";
+}
+
+void DatagramSender::printStats(ostream &out) const {
+    out << "Sent " << datagrams << " queued datagrams in " << calls << " " << backend() << " calls" << endl;
+}
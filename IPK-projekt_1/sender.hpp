@@ -0,0 +1,106 @@
+/**
+* @file sender.hpp
+* @brief Header file for the DatagramSender class
+*/
+#ifndef SENDER_HPP
+#define SENDER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#ifdef USE_IO_URING
+#include "uring.hpp"
+#endif
+
+/**
+* @class DatagramSender
+* @brief Collects outgoing datagrams and sends them with one sendmmsg call
+*
+* Used for CONFIRMs and retransmissions produced while one batch of received
+* datagrams is processed. The queue is flushed at the end of the pass, or
+* earlier when it is full, so a datagram is never delayed by more than one
+* pass of the event loop.
+*
+* Built with USE_IO_URING (make IO_URING=1), the queue is submitted as one batch of
+* SENDMSG requests to an io_uring instead, if the kernel supports it.
+*/
+class DatagramSender {
+public:
+    static const int BATCH = 64; /**< Maximum number of queued datagrams */
+
+    /**
+    * @brief Constructor for the DatagramSender class
+    */
+    DatagramSender();
+
+    /**
+    * @brief Queues a CONFIRM, its 3 bytes are stored in the sender.
+    * @param sock The socket used if the queue has to be flushed.
+    * @param address Destination address.
+    * @param refMessageID The reference message ID to confirm.
+    */
+    void queueConfirm(int sock, const struct sockaddr_in &address, int refMessageID);
+
+    /**
+    * @brief Queues a datagram without copying it.
+    *
+    * The data must stay valid until the next flush.
+    *
+    * @param sock The socket used if the queue has to be flushed.
+    * @param address Destination address.
+    * @param data Datagram to send.
+    * @param length Size of the datagram.
+    */
+    void queue(int sock, const struct sockaddr_in &address, const unsigned char *data, size_t length);
+
+    /**
+    * @brief Sends all queued datagrams.
+    * @param sock The socket to send through.
+    * @return false if sending failed, true otherwise.
+    */
+    bool flush(int sock);
+
+    /**
+    * @brief Checks if there is anything to send.
+    * @return true if the queue is empty.
+    */
+    bool empty() const;
+
+    /**
+    * @brief Writes the number of sent datagrams and sendmmsg calls.
+    * @param out Output stream.
+    */
+    void printStats(std::ostream &out) const;
+
+    /**
+    * @brief Name of the backend in use.
+    * @return "io_uring" or "sendmmsg".
+    */
+    const char* backend() const;
+
+    uint64_t calls; /**< Number of sendmmsg or io_uring_enter calls */
+    uint64_t datagrams; /**< Number of datagrams sent through the queue */
+
+private:
+    int count; /**< Number of queued datagrams */
+    unsigned char confirms[BATCH][3]; /**< Storage of queued CONFIRMs */
+    struct sockaddr_in addresses[BATCH]; /**< Destinations */
+    struct iovec iovecs[BATCH]; /**< Datagram descriptors for sendmmsg */
+    struct mmsghdr headers[BATCH]; /**< Message headers for sendmmsg */
+
+#ifdef USE_IO_URING
+    /**
+    * @brief Submits all queued datagrams to the ring and waits until they are sent.
+    * @param sock The socket to send through.
+    * @return false if sending failed, true otherwise.
+    */
+    bool flushRing(int sock);
+
+    Uring ring; /**< Ring of the SENDMSG requests */
+    bool ringTried; /**< Creating the ring has been attempted */
+#endif
+};
+
+#endif /* SENDER_HPP */
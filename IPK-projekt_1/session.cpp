@@ -0,0 +1,284 @@
+#include "session.hpp"
+#include "validate.hpp"
+#include <iostream>
+#include <cctype>
+
+using namespace std;
+
+// Returns the next whitespace separated word of line starting at pos and moves pos after it
+static string_view nextWord(string_view line, size_t &pos) {
+    while (pos < line.size() && isspace(static_cast<unsigned char>(line[pos]))) {
+        ++pos;
+    }
+    size_t start = pos;
+    while (pos < line.size() && !isspace(static_cast<unsigned char>(line[pos]))) {
+        ++pos;
+    }
+    return line.substr(start, pos - start);
+}
+
+bool validCredentials(string_view username, string_view secret, string_view displayName) {
+    return USERNAME_RULE.matches(username) && SECRET_RULE.matches(secret) && DISPLAY_NAME_RULE.matches(displayName);
+}
+
+// Checks the fields of a server message against the rules of the protocol
+static bool validServerFields(const ServerMessage &message) {
+    switch (message.kind) {
+    case KIND_MSG:
+    case KIND_ERR:
+        return DISPLAY_NAME_RULE.matches(message.displayName) && CONTENT_RULE.matches(message.content);
+    case KIND_REPLY:
+        return CONTENT_RULE.matches(message.content);
+    default:
+        return true;
+    }
+}
+
+Session::Session(int replyTimeoutMs) : current(START), repliesPending(0), replyTimeoutMs(replyTimeoutMs) {}
+
+const vector<Action>& Session::userLine(string_view line) {
+    actions.clear();
+    switch (current) {
+    case START:
+        authCommand(line);
+        break;
+    case AUTH:
+        // The REPLY to AUTH is awaited, only an empty line (end of input) is handled
+        if (line.empty()) {
+            end();
+        }
+        break;
+    case OPEN:
+        openCommand(line);
+        break;
+    default:
+        break;
+    }
+    return actions;
+}
+
+void Session::authCommand(string_view line) {
+    size_t pos = 0;
+    string_view command = nextWord(line, pos);
+    if (command == "/help") {
+        print(false, "", "", "To authorize, use:");
+        print(false, "", "", "/auth username secret displayName");
+    }
+    else if (command != "/auth") {
+        print(true, "", "", "ERR: Invalid command. Expected '/auth' or '/help'.");
+    }
+    else {
+        string_view newUsername = nextWord(line, pos);
+        string_view newSecret = nextWord(line, pos);
+        string_view newDisplayName = nextWord(line, pos);
+        if (!validCredentials(newUsername, newSecret, newDisplayName)) {
+            print(true, "", "", "ERR: Invalid input format. Use /auth username secret displayName");
+            return;
+        }
+        username = newUsername;
+        secret = newSecret;
+        displayName = newDisplayName;
+        ClientMessage message = {};
+        message.kind = CLIENT_AUTH;
+        message.username = username;
+        message.secret = secret;
+        message.displayName = displayName;
+        send(message);
+        ++repliesPending;
+        current = AUTH;
+    }
+}
+
+void Session::openCommand(string_view line) {
+    if (line.empty()) {
+        end();
+        return;
+    }
+    size_t pos = 0;
+    string_view command = nextWord(line, pos);
+    if (command == "/auth") {
+        print(true, "", "", "ERR: You are already authorized. This command cannot be used.");
+    }
+    else if (command == "/join") {
+        string_view channelID = nextWord(line, pos);
+        // Exactly one valid parameter, not even trailing whitespace
+        if (pos != line.size() || !CHANNEL_RULE.matches(channelID)) {
+            print(true, "", "", "ERR: Invalid usage of /join command. Usage: /join <channelID>");
+            return;
+        }
+        ClientMessage message = {};
+        message.kind = CLIENT_JOIN;
+        message.channelID = channelID;
+        message.displayName = displayName;
+        send(message);
+        ++repliesPending;
+        if (replyTimeoutMs > 0) {
+            Action action = {};
+            action.kind = ACTION_ARM_TIMER;
+            action.timeoutMs = replyTimeoutMs;
+            actions.push_back(action);
+        }
+    }
+    else if (command == "/rename") {
+        string_view newName = nextWord(line, pos);
+        if (pos != line.size() || !DISPLAY_NAME_RULE.matches(newName)) {
+            print(true, "", "", "ERR: Invalid usage of /rename command. Usage: /rename <newName>");
+            return;
+        }
+        displayName = string(newName);
+    }
+    else if (command == "/help") {
+        print(false, "", "", "To join channels, use:");
+        print(false, "", "", "/join channelID");
+        print(false, "", "", "To change your display name, use:");
+        print(false, "", "", "/rename newName");
+    }
+    else if (!CONTENT_RULE.matches(line)) {
+        print(true, "", "", "ERR: Invalid message. Use 1-1400 printable ASCII characters.");
+    }
+    else {
+        ClientMessage message = {};
+        message.kind = CLIENT_MSG;
+        message.displayName = displayName;
+        message.content = line;
+        send(message);
+    }
+}
+
+const vector<Action>& Session::inputClosed() {
+    actions.clear();
+    if (current != END) {
+        end();
+    }
+    return actions;
+}
+
+const vector<Action>& Session::serverMessage(const ServerMessage &message) {
+    actions.clear();
+    if (current == END || current == ERROR) {
+        return actions;
+    }
+    if (!validServerFields(message)) {
+        invalidMessage();
+        return actions;
+    }
+    if (current == AUTH && message.kind == KIND_REPLY) {
+        --repliesPending;
+        if (message.replyOk) {
+            print(true, "Success: ", "", message.content);
+            current = OPEN;
+        } else {
+            // The user has to authorize again
+            print(true, "Failure: ", "", message.content);
+            current = START;
+        }
+        return actions;
+    }
+    switch (message.kind) {
+    case KIND_BYE:
+        end();
+        break;
+    case KIND_ERR:
+        print(true, "ERR FROM ", message.displayName, message.content);
+        end();
+        break;
+    case KIND_MSG:
+        print(false, "", message.displayName, message.content);
+        break;
+    case KIND_REPLY:
+        if (current != OPEN || repliesPending == 0) {
+            invalidMessage();
+            break;
+        }
+        // REPLY to JOIN, the client stays in OPEN either way
+        --repliesPending;
+        if (repliesPending == 0 && replyTimeoutMs > 0) {
+            Action action = {};
+            action.kind = ACTION_CANCEL_TIMER;
+            actions.push_back(action);
+        }
+        print(true, message.replyOk ? "Success: " : "Failure: ", "", message.content);
+        break;
+    default:
+        invalidMessage();
+        break;
+    }
+    return actions;
+}
+
+const vector<Action>& Session::timerExpired() {
+    actions.clear();
+    if (current == OPEN && repliesPending > 0) {
+        print(true, "", "", "ERR: no REPLY to JOIN from server");
+        ClientMessage message = {};
+        message.kind = CLIENT_ERR;
+        message.displayName = displayName;
+        message.content = "No REPLY to JOIN";
+        send(message);
+        end();
+    }
+    return actions;
+}
+
+void Session::invalidMessage() {
+    print(true, "", "", "ERR: invalid message from server");
+    ClientMessage message = {};
+    message.kind = CLIENT_ERR;
+    message.displayName = displayName;
+    message.content = "Invalid message from server";
+    send(message);
+    end();
+}
+
+void Session::send(const ClientMessage &message) {
+    Action action = {};
+    action.kind = ACTION_SEND;
+    action.message = message;
+    actions.push_back(action);
+}
+
+void Session::print(bool error, string_view prefix, string_view name, string_view text) {
+    Action action = {};
+    action.kind = ACTION_PRINT;
+    action.error = error;
+    action.prefix = prefix;
+    action.name = name;
+    action.text = text;
+    actions.push_back(action);
+}
+
+void Session::end() {
+    current = END;
+    repliesPending = 0;
+    Action action = {};
+    action.kind = ACTION_END;
+    actions.push_back(action);
+}
+
+State Session::state() const {
+    return current;
+}
+
+int Session::pendingReplies() const {
+    return repliesPending;
+}
+
+void Session::printState(ostream &out) const {
+    switch (current) {
+    case START:
+        out << "Current state: START" << endl;
+        break;
+    case AUTH:
+        out << "Current state: AUTH" << endl;
+        break;
+    case OPEN:
+        out << "Current state: OPEN" << endl;
+        break;
+    case END:
+        out << "Current state: END" << endl;
+        break;
+    case ERROR:
+        out << "Current state: ERROR" << endl;
+        break;
+    }
+}
@@ -0,0 +1,202 @@
+/**
+* @file session.hpp
+* @brief Header file for the Session class, the protocol logic shared by TCP and UDP
+*/
+#ifndef SESSION_HPP
+#define SESSION_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ostream>
+#include "parser.hpp"
+
+/**
+* @brief Enumeration representing possible states of the communication
+*/
+enum State {
+    START, /**< Initial state, waiting for /auth */
+    AUTH,  /**< Authentication state, waiting for the REPLY to AUTH */
+    OPEN,  /**< Communication open state */
+    END,   /**< End of communication state */
+    ERROR  /**< Error state */
+};
+
+/**
+* @brief Kind of an action requested by the session
+*/
+enum ActionKind {
+    ACTION_SEND,         /**< Encode and send message */
+    ACTION_PRINT,        /**< Print a line to the user */
+    ACTION_ARM_TIMER,    /**< Call timerExpired after timeoutMs, replaces an armed timer */
+    ACTION_CANCEL_TIMER, /**< Disarm the timer */
+    ACTION_END           /**< The session is over, the transport says BYE and closes */
+};
+
+/**
+* @brief Kind of a message sent to the server
+*/
+enum ClientKind {
+    CLIENT_AUTH, /**< AUTH username, displayName, secret */
+    CLIENT_JOIN, /**< JOIN channelID, displayName */
+    CLIENT_MSG,  /**< MSG displayName, content */
+    CLIENT_ERR,  /**< ERR displayName, content */
+    CLIENT_BYE   /**< BYE */
+};
+
+/**
+* @brief Fields of a message to be encoded by the transport
+*/
+struct ClientMessage {
+    ClientKind kind; /**< Kind of the message */
+    std::string_view username; /**< Username (AUTH) */
+    std::string_view secret; /**< Secret (AUTH) */
+    std::string_view displayName; /**< Display name of the client */
+    std::string_view channelID; /**< Channel (JOIN) */
+    std::string_view content; /**< Message content (MSG and ERR) */
+};
+
+/**
+* @brief One action produced by the session
+*
+* A printed line is prefix, then name followed by ": " if name is not empty, then text.
+*/
+struct Action {
+    ActionKind kind; /**< Kind of the action */
+    ClientMessage message; /**< Message to send (ACTION_SEND) */
+    bool error; /**< Print to stderr instead of stdout (ACTION_PRINT) */
+    std::string_view prefix; /**< First part of the line (ACTION_PRINT) */
+    std::string_view name; /**< Display name of the sender (ACTION_PRINT) */
+    std::string_view text; /**< Rest of the line (ACTION_PRINT) */
+    int timeoutMs; /**< Timer duration (ACTION_ARM_TIMER) */
+};
+
+/**
+* @class Session
+* @brief Protocol state machine without any I/O
+*
+* User lines, decoded server messages and timer expirations go in, every input
+* returns the batch of actions the transport has to perform. The session never
+* reads, writes or looks at the clock, so TCP and UDP share it and only encode,
+* decode and deliver the messages.
+*
+* The returned batch is reused by the next input. Its views point into the
+* session, into the user line or into the server message, so the batch has to be
+* performed before any of them changes.
+*/
+class Session {
+public:
+    /**
+    * @brief Constructor for the Session class
+    * @param replyTimeoutMs Time to wait for the REPLY to JOIN, 0 to wait forever.
+    */
+    Session(int replyTimeoutMs = 0);
+
+    /**
+    * @brief Processes one line typed by the user.
+    *
+    * Before authorization only /auth and /help are accepted, afterwards /join, /rename,
+    * /help and messages. An empty line ends the session.
+    *
+    * @param line The line without the newline.
+    * @return Actions to perform.
+    */
+    const std::vector<Action>& userLine(std::string_view line);
+
+    /**
+    * @brief Processes the end of the user input.
+    * @return Actions to perform.
+    */
+    const std::vector<Action>& inputClosed();
+
+    /**
+    * @brief Processes a decoded message from the server.
+    *
+    * Duplicates and CONFIRMs are handled by the transport and never get here.
+    *
+    * @param message The message, KIND_INVALID if it could not be decoded.
+    * @return Actions to perform.
+    */
+    const std::vector<Action>& serverMessage(const ServerMessage &message);
+
+    /**
+    * @brief Processes the expiration of the timer armed by ACTION_ARM_TIMER.
+    * @return Actions to perform.
+    */
+    const std::vector<Action>& timerExpired();
+
+    /**
+    * @brief Current state of the session.
+    * @return The state.
+    */
+    State state() const;
+
+    /**
+    * @brief Number of sent AUTH and JOIN messages whose REPLY has not arrived.
+    * @return Number of pending REPLYs.
+    */
+    int pendingReplies() const;
+
+    /**
+    * @brief Prints the current state of the session, used for debugging.
+    * @param out Output stream.
+    */
+    void printState(std::ostream &out) const;
+
+private:
+    /**
+    * @brief Handles a line in the START state.
+    * @param line The line typed by the user.
+    */
+    void authCommand(std::string_view line);
+
+    /**
+    * @brief Handles a line in the OPEN state.
+    * @param line The line typed by the user.
+    */
+    void openCommand(std::string_view line);
+
+    /**
+    * @brief Adds a message to send.
+    * @param message The message.
+    */
+    void send(const ClientMessage &message);
+
+    /**
+    * @brief Adds a line to print.
+    * @param error Print to stderr.
+    * @param prefix First part of the line.
+    * @param name Display name, followed by ": " if not empty.
+    * @param text Rest of the line.
+    */
+    void print(bool error, std::string_view prefix, std::string_view name, std::string_view text);
+
+    /**
+    * @brief Adds an ERR for an invalid server message and ends the session.
+    */
+    void invalidMessage();
+
+    /**
+    * @brief Moves to END and adds ACTION_END.
+    */
+    void end();
+
+    std::vector<Action> actions; /**< Batch returned by the last input */
+    State current; /**< Current state */
+    std::string username; /**< Username for authentication */
+    std::string secret; /**< Secret for authentication */
+    std::string displayName; /**< Display name */
+    int repliesPending; /**< Sent AUTH and JOIN messages without REPLY */
+    int replyTimeoutMs; /**< Timeout of the REPLY to JOIN, 0 if none */
+};
+
+/**
+* @brief Checks the constraints of the /auth parameters with the rules of validate.hpp.
+* @param username Username, 1-20 characters A-Z, a-z, 0-9 and dash.
+* @param secret Secret, 1-128 characters A-Z, a-z, 0-9 and dash.
+* @param displayName Display name, 1-20 printable characters without space.
+* @return true if all three are valid.
+*/
+bool validCredentials(std::string_view username, std::string_view secret, std::string_view displayName);
+
+#endif /* SESSION_HPP */
@@ -7,59 +7,46 @@
 
 #include <iostream>
 #include <string>
-#include <regex>
 #include <sstream>
 #include <vector>
-
-/**
-* @brief Enumeration representing possible states of the TCP communication
-*/
-#ifndef STATE
-#define STATE
-enum State {
-    START, /**< Initial state */
-    AUTH,  /**< Authentication state */
-    OPEN,  /**< Communication open state */
-    END,   /**< End of communication state */
-    ERROR  /**< Error state */
-};
-#endif // STATE
+#include <string_view>
+#include <chrono>
+#include <deque>
+#include "framer.hpp"
+#include "parser.hpp"
+#include "session.hpp"
+#include "histogram.hpp"
+#include "metrics.hpp"
 
 /**
 * @class TCP
 * @brief Class representing TCP communication functionality
+*
+* Encodes the messages requested by the session into the text grammar, passes
+* the messages parsed from the socket to the session and performs its actions.
 */
 class TCP {
-private: 
+private:
     int sock; /**< Socket descriptor */
 public:
-    std::string username; /**< Username for authentication */
-    std::string secret; /**< Secret for authentication */
-    std::string displayName; /**< Display name */
-    State currentState; /**< Current state of the communication */
+    Session session; /**< Protocol state machine */
     int sockClose; /**< Socket descriptor for final bye message */
+    Framer framer; /**< Reassembles CRLF terminated messages from the socket */
+    bool timerArmed; /**< The session waits for a REPLY with a deadline */
+    std::chrono::steady_clock::time_point replyDeadline; /**< Time by which the REPLY must arrive */
+    bool quiet = false; /**< Lines of the session are not printed (load generator) */
+    std::string output; /**< Encoded message, the buffer is reused by every send */
+    MessageHistograms* histograms = nullptr; /**< Receives the REPLY latencies if set */
+    std::deque<std::chrono::steady_clock::time_point> replyStarts; /**< Send times of AUTH and JOIN without REPLY, oldest first */
+    ThreadMetrics &metrics; /**< Counters of the thread that created the session */
+    StateClock stateClock; /**< Time spent in each state of the session */
+    static constexpr int REPLY_TIMEOUT_MS = 5000; /**< Time to wait for a REPLY */
 
     /**
     * @brief Constructor for the TCP class
     */
     TCP();
 
-    /**
-    * @brief Initiates communication with the server (first message).
-    * 
-    * This function handles the initial communication with the server. It prompts the user
-    * for input, expecting an authentication command (/auth) followed by username, secret, and
-    * display name. If the input matches the expected format, an authentication message is
-    * created and sent to the server. If the input is invalid or EOF (end-of-file) is detected,
-    * the function terminates the communication.
-    * 
-    * @param sock The socket for communication with the server.
-    * @param username Reference to the username variable to be set based on user input.
-    * @param secret Reference to the secret variable to be set based on user input.
-    * @param displayName Reference to the display name variable to be set based on user input.
-    */
-    void startCommunication(int sock, std::string &username, std::string &secret, std::string &displayName);
-
     /**
     * @brief Sends an authentication message over TCP.
     *
@@ -71,7 +58,7 @@ public:
     * @param secret The secret for authentication.
     * @param displayName The display name associated with the user.
     */
-    void sendAuthentication(int sock, const std::string &username, const std::string &secret, const std::string &displayName);
+    void sendAuthentication(int sock, std::string_view username, std::string_view secret, std::string_view displayName);
 
     /**
     * @brief Sends a join message over TCP.
@@ -83,7 +70,7 @@ public:
     * @param channelID The ID of the channel to join.
     * @param displayName The display name associated with the user.
     */
-    void sendJoin(int sock, const std::string &channelID, const std::string &displayName);
+    void sendJoin(int sock, std::string_view channelID, std::string_view displayName);
 
     /**
     * @brief Sends an error message over TCP.
@@ -95,7 +82,7 @@ public:
     * @param content The content of the error message.
     * @param displayName The display name associated with the user.
     */
-    void sendERR(int sock, const std::string &content, const std::string &displayName);
+    void sendERR(int sock, std::string_view content, std::string_view displayName);
 
     /**
     * @brief Sends a message over TCP.
@@ -107,7 +94,15 @@ public:
     * @param content The content of the message.
     * @param displayName The display name associated with the user.
     */
-    void sendMSG(int sock, const std::string &content, const std::string &displayName);
+    void sendMSG(int sock, std::string_view content, std::string_view displayName);
+
+    /**
+    * @brief Encodes a message requested by the session and sends it over TCP.
+    * @param sock The socket over which to send the message.
+    * @param message The message.
+    * @return false if the message could not be sent.
+    */
+    bool sendMessage(int sock, const ClientMessage &message);
 
     /**
     * @brief Sends a BYE message over TCP.
@@ -119,61 +114,55 @@ public:
     void sendBYE(int sock);
 
     /**
-    * @brief Handles input from the client and sends appropriate messages over TCP.
-    *
-    * This function reads input from the standard input (stdin) and processes it based on the current state of the client.
-    * If the input is empty, it sets the current state to END and exits.
-    * If the input is a command, it executes the corresponding action based on the command and the current state.
-    * Supported commands include:
-    *   - /auth: Displays an error message.
-    *   - /join <channelID>: Sends a join message to the server.
-    *   - /rename <newName>: Changes the display name of the client.
-    * If the input is not a command, it treats it as a message and sends it to the server as a regular message.
-    *
+    * @brief Passes one line typed by the user to the session.
     * @param sock The socket over which to send messages.
-    * @param content A reference to the content/message to be sent.
-    * @param displayName A reference to the display name of the client.
+    * @param line The line without the newline.
     */
-    void sendingFromClient(int sock, std::string &content, std::string &displayName);
+    void sendingFromClient(int sock, std::string_view line);
 
     /**
-    * @brief Sends a join message to the server and handles the server response.
+    * @brief Passes the end of the user input to the session.
+    * @param sock The socket over which to send messages.
+    */
+    void endOfInput(int sock);
+
+    /**
+    * @brief Checks if the next user line may be passed to the session.
     *
-    * This function sends a join message to the server with the specified channel ID and display name.
-    * It then enters a loop to receive and process the server's response. If the response indicates success (REPLY OK IS),
-    * it prints a success message and exits the loop. Otherwise, it prints a failure message.
+    * No line is passed while the REPLY to AUTH or JOIN is pending, the input stays buffered.
     *
-    * @param sock The socket over which to send and receive messages.
-    * @param content A reference to the content/message received from the server.
-    * @param displayName A reference to the display name of the client.
-    * @param channelID A reference to the ID of the channel to join.
+    * @return true if the session accepts the next line.
     */
-    void sendingJoin(int sock, std::string &content, std::string &displayName, std::string &channelID);
+    bool acceptsInput() const;
 
     /**
-    * @brief Determines the next state based on the current state and server response.
+    * @brief Computes the poll timeout from the deadline of the pending REPLY.
+    * @return Milliseconds until the deadline, -1 if no REPLY is pending.
+    */
+    int nextTimeout() const;
+
+    /**
+    * @brief Passes the expiration of the REPLY deadline to the session.
+    * @param sock The socket over which to send the message.
+    */
+    void processTimeout(int sock);
+
+    /**
+    * @brief Passes one message from the server to the session.
     *
-    * This function implements a finite state machine to determine the next state of the client based on the current state and the type of message received from the server.
-    * The client transitions between states according to predefined rules, responding to server messages appropriately.
+    * The message is parsed by parseServerMessage without any copy.
     *
-    * @param currentState The current state of the client, defined by the finite state machine.
-    * @param serverResponse Buffer containing the server response.
+    * @param serverResponse One complete message from the server without the terminating CRLF.
     * @param sock Socket for communication with the server.
-    * @return The next state of the client, as determined by the finite state machine.
     */
-    State nextState(State currentState, const std::string &serverResponse, int sock);
+    void receive(std::string_view serverResponse, int sock);
 
     /**
-    * @brief Prints the current state of the client.
-    *
-    * This function is a utility for tracking the state of the client within the finite state machine.
-    * It prints out the current state of the client to the standard output stream.
-    * 
-    * This function was primarily used for testing and debugging purposes.
-    *
-    * @param state The current state of the client.
+    * @brief Performs the actions returned by the session.
+    * @param actions The actions.
+    * @param sock Socket for communication with the server.
     */
-    void printState(State state);
+    void perform(const std::vector<Action> &actions, int sock);
 
     /**
     * @brief Destructor for the TCP class
@@ -0,0 +1,326 @@
+/**
+* @file session_test.cpp
+* @brief Checks of the Session state machine and of the UDP transport driving it
+*
+* Every case feeds user lines, server messages and timer expirations into a
+* Session and compares the returned batch of actions, written one action per
+* "|" separated item, with the expected one. The UDP case talks to a socket on
+* the loopback that plays the server and compares the datagrams it receives.
+*/
+#include "../session.hpp"
+#include "../udp.hpp"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+static int checks = 0;
+static int failures = 0;
+
+static const char* messageKindName(ClientKind kind) {
+    switch (kind) {
+    case CLIENT_AUTH:
+        return "AUTH";
+    case CLIENT_JOIN:
+        return "JOIN";
+    case CLIENT_MSG:
+        return "MSG";
+    case CLIENT_ERR:
+        return "ERR";
+    case CLIENT_BYE:
+        return "BYE";
+    }
+    return "?";
+}
+
+// Writes a batch as "SEND AUTH user Name|PRINT! Success: ok|END", "!" marks stderr
+static string describe(const vector<Action> &actions) {
+    string text;
+    for (const Action &action : actions) {
+        if (!text.empty()) {
+            text += "|";
+        }
+        switch (action.kind) {
+        case ACTION_SEND:
+            text += "SEND ";
+            text += messageKindName(action.message.kind);
+            switch (action.message.kind) {
+            case CLIENT_AUTH:
+                text += " " + string(action.message.username) + " " + string(action.message.displayName);
+                break;
+            case CLIENT_JOIN:
+                text += " " + string(action.message.channelID);
+                break;
+            case CLIENT_MSG:
+            case CLIENT_ERR:
+                text += " " + string(action.message.content);
+                break;
+            case CLIENT_BYE:
+                break;
+            }
+            break;
+        case ACTION_PRINT:
+            text += action.error ? "PRINT! " : "PRINT ";
+            text += string(action.prefix) + string(action.name) + (action.name.empty() ? "" : ": ") + string(action.text);
+            break;
+        case ACTION_ARM_TIMER:
+            text += "ARM " + to_string(action.timeoutMs);
+            break;
+        case ACTION_CANCEL_TIMER:
+            text += "CANCEL";
+            break;
+        case ACTION_END:
+            text += "END";
+            break;
+        }
+    }
+    return text;
+}
+
+static void expect(const string &name, const vector<Action> &actions, const string &expected) {
+    ++checks;
+    string actual = describe(actions);
+    if (actual != expected) {
+        ++failures;
+        cerr << "FAIL " << name << endl << "  expected: " << expected << endl << "  actual:   " << actual << endl;
+    }
+}
+
+static void expectState(const string &name, const Session &session, State expected) {
+    ++checks;
+    if (session.state() != expected) {
+        ++failures;
+        cerr << "FAIL " << name << ": unexpected state" << endl;
+    }
+}
+
+static ServerMessage reply(bool ok, string_view content) {
+    ServerMessage message = {};
+    message.kind = KIND_REPLY;
+    message.replyOk = ok;
+    message.content = content;
+    return message;
+}
+
+static ServerMessage chat(MessageKind kind, string_view displayName, string_view content) {
+    ServerMessage message = {};
+    message.kind = kind;
+    message.displayName = displayName;
+    message.content = content;
+    return message;
+}
+
+// Session authorized as user/Name, in the OPEN state
+static void authorize(Session &session) {
+    session.userLine("/auth user secret Name");
+    session.serverMessage(reply(true, "ok"));
+}
+
+static void authRetry() {
+    Session session;
+    expect("auth: invalid credentials", session.userLine("/auth user"),
+        "PRINT! ERR: Invalid input format. Use /auth username secret displayName");
+    expect("auth: AUTH sent", session.userLine("/auth user secret Name"), "SEND AUTH user Name");
+    expectState("auth: waiting for REPLY", session, AUTH);
+    expect("auth: lines ignored while waiting", session.userLine("hello"), "");
+    expect("auth: REPLY NOK", session.serverMessage(reply(false, "bad secret")), "PRINT! Failure: bad secret");
+    expectState("auth: back to START", session, START);
+    expect("auth: messages refused before AUTH", session.userLine("hello"),
+        "PRINT! ERR: Invalid command. Expected '/auth' or '/help'.");
+    expect("auth: retry", session.userLine("/auth user secret Other"), "SEND AUTH user Other");
+    expect("auth: REPLY OK", session.serverMessage(reply(true, "welcome")), "PRINT! Success: welcome");
+    expectState("auth: OPEN", session, OPEN);
+    expect("auth: messages accepted", session.userLine("hello"), "SEND MSG hello");
+    expect("auth: non-ASCII message refused", session.userLine("ahoj světe"),
+        "PRINT! ERR: Invalid message. Use 1-1400 printable ASCII characters.");
+}
+
+static void joinTimeout() {
+    Session session(5000);
+    authorize(session);
+    expect("join: JOIN arms the timer", session.userLine("/join general"), "SEND JOIN general|ARM 5000");
+    expect("join: no REPLY", session.timerExpired(),
+        "PRINT! ERR: no REPLY to JOIN from server|SEND ERR No REPLY to JOIN|END");
+    expectState("join: ended", session, END);
+
+    Session replied(5000);
+    authorize(replied);
+    replied.userLine("/join general");
+    expect("join: REPLY cancels the timer", replied.serverMessage(reply(true, "joined")), "CANCEL|PRINT! Success: joined");
+    expect("join: late timer is ignored", replied.timerExpired(), "");
+    expectState("join: still OPEN", replied, OPEN);
+}
+
+static void serverError() {
+    Session session;
+    authorize(session);
+    expect("err: MSG printed", session.serverMessage(chat(KIND_MSG, "Alice", "hi")), "PRINT Alice: hi");
+    expect("err: ERR ends the session", session.serverMessage(chat(KIND_ERR, "Server", "overloaded")),
+        "PRINT! ERR FROM Server: overloaded|END");
+    expectState("err: ended", session, END);
+    expect("err: nothing after END", session.serverMessage(chat(KIND_MSG, "Alice", "hi")), "");
+}
+
+static void invalidMessage() {
+    const string answer = "PRINT! ERR: invalid message from server|SEND ERR Invalid message from server|END";
+
+    Session undecoded;
+    authorize(undecoded);
+    ServerMessage invalid = {};
+    invalid.kind = KIND_INVALID;
+    expect("invalid: undecodable message", undecoded.serverMessage(invalid), answer);
+    expectState("invalid: ended", undecoded, END);
+
+    Session badField;
+    authorize(badField);
+    expect("invalid: control character in content", badField.serverMessage(chat(KIND_MSG, "Alice", "a\x01b")), answer);
+
+    Session unexpected;
+    authorize(unexpected);
+    expect("invalid: REPLY without a request", unexpected.serverMessage(reply(true, "ok")), answer);
+}
+
+// Names the datagrams waiting on the server socket as "AUTH|CONFIRM|...", the socket is drained
+static string receivedDatagrams(int server) {
+    string text;
+    char data[1500];
+    ssize_t length;
+    while ((length = recv(server, data, sizeof(data), MSG_DONTWAIT)) > 0) {
+        if (!text.empty()) {
+            text += "|";
+        }
+        switch (static_cast<unsigned char>(data[0])) {
+        case 0x00:
+            text += "CONFIRM";
+            break;
+        case 0x02:
+            text += "AUTH";
+            break;
+        case 0x03:
+            text += "JOIN";
+            break;
+        case 0x04:
+            text += "MSG";
+            break;
+        case 0xFE:
+            text += "ERR";
+            break;
+        case 0xFF:
+            text += "BYE";
+            break;
+        default:
+            text += "?";
+            break;
+        }
+    }
+    return text;
+}
+
+static void expectDatagrams(const string &name, int server, const string &expected) {
+    ++checks;
+    string actual = receivedDatagrams(server);
+    if (actual != expected) {
+        ++failures;
+        cerr << "FAIL " << name << endl << "  expected: " << expected << endl << "  actual:   " << actual << endl;
+    }
+}
+
+// Creates the socket playing the server and the client socket, the UDP object closes the client one
+static bool openLoopback(const string &name, int &server, int &client, uint16_t &port) {
+    server = socket(AF_INET, SOCK_DGRAM, 0);
+    client = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addressLength = sizeof(address);
+    if (server < 0 || client < 0 || bind(server, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0
+        || getsockname(server, reinterpret_cast<struct sockaddr*>(&address), &addressLength) < 0) {
+        ++checks;
+        ++failures;
+        cerr << "FAIL " << name << ": cannot create the loopback sockets" << endl;
+        return false;
+    }
+    port = ntohs(address.sin_port);
+    return true;
+}
+
+// Client quiet on the console that sends to the loopback server
+static void setUpClient(UDP &udp, int client, uint16_t port) {
+    udp.quiet = true;
+    udp.r = 3;
+    udp.d = 250;
+    udp.rtt.reset(250);
+    udp.sockClose = client;
+    udp.setServerAddress("127.0.0.1", port);
+}
+
+// A JOIN that is CONFIRMed is no longer retransmitted, only the REPLY deadline ends the wait
+static void udpJoinWithoutReply() {
+    int server, client;
+    uint16_t port;
+    if (!openLoopback("udp", server, client, port)) {
+        return;
+    }
+    {
+        UDP udp;
+        setUpClient(udp, client, port);
+
+        udp.sendingFromClient(client, "/auth user secret Name");
+        const char authConfirm[] = {0x00, 0x00, 0x00};
+        udp.receive(authConfirm, sizeof(authConfirm), client);
+        const char authReply[] = {0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 'o', 'k', 0x00};
+        udp.receive(authReply, sizeof(authReply), client);
+        expectDatagrams("udp: AUTH sent and REPLY confirmed", server, "AUTH|CONFIRM");
+
+        udp.sendingFromClient(client, "/join general");
+        const char joinConfirm[] = {0x00, 0x00, 0x01};
+        udp.receive(joinConfirm, sizeof(joinConfirm), client);
+        udp.sendingFromClient(client, "hello");
+        expectDatagrams("udp: MSG held back behind the JOIN", server, "JOIN");
+        ++checks;
+        if (!udp.timerArmed || udp.nextTimeout() < 0) {
+            ++failures;
+            cerr << "FAIL udp: no deadline for the REPLY to JOIN" << endl;
+        }
+
+        // The deadline passes, the session gives up on the REPLY
+        udp.replyDeadline = chrono::steady_clock::now();
+        udp.processTimers(client);
+        expectState("udp: ended", udp.session, END);
+        expectDatagrams("udp: ERR and BYE after the deadline", server, "MSG|ERR|BYE");
+    }
+    close(server);
+}
+
+// A session the event loop did not close still says BYE, also with the window full
+static void udpByeFromDestructor() {
+    int server, client;
+    uint16_t port;
+    if (!openLoopback("udp bye", server, client, port)) {
+        return;
+    }
+    {
+        UDP udp;
+        setUpClient(udp, client, port);
+        udp.window = 1;
+        udp.sendingFromClient(client, "/auth user secret Name");
+    }
+    expectDatagrams("udp bye: BYE past the unconfirmed AUTH", server, "AUTH|BYE");
+    close(server);
+}
+
+int main() {
+    authRetry();
+    joinTimeout();
+    serverError();
+    invalidMessage();
+    udpJoinWithoutReply();
+    udpByeFromDestructor();
+    cout << checks << " checks, " << failures << " failed" << endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,35 @@
+#include "timer.hpp"
+
+using namespace std;
+
+void RetransmitTimer::schedule(int messageID, Clock::time_point deadline){
+    heap.push(Entry{deadline, messageID});
+}
+
+bool RetransmitTimer::expired(Clock::time_point now, Entry &entry){
+    if (heap.empty() || heap.top().deadline > now) {
+        return false;
+    }
+    entry = heap.top();
+    heap.pop();
+    return true;
+}
+
+int RetransmitTimer::timeout(Clock::time_point now) const {
+    if (heap.empty()) {
+        return -1;
+    }
+    if (heap.top().deadline <= now) {
+        return 0;
+    }
+    auto remaining = chrono::duration_cast<chrono::microseconds>(heap.top().deadline - now).count();
+    return static_cast<int>((remaining + 999) / 1000);
+}
+
+bool RetransmitTimer::empty() const {
+    return heap.empty();
+}
+
+void RetransmitTimer::clear(){
+    heap = priority_queue<Entry, vector<Entry>, Later>();
+}
@@ -0,0 +1,79 @@
+/**
+* @file timer.hpp
+* @brief Header file for the RetransmitTimer class
+*/
+#ifndef TIMER_HPP
+#define TIMER_HPP
+
+#include <chrono>
+#include <queue>
+#include <vector>
+
+/**
+* @class RetransmitTimer
+* @brief Deadlines of sent messages ordered in a min-heap
+*
+* Every sent message that waits for a CONFIRM has a deadline in the heap.
+* Entries are never removed from the middle, a message that was confirmed or
+* retransmitted in the meantime leaves a stale entry which the owner skips
+* when it expires (the owner compares the deadline with the message).
+*/
+class RetransmitTimer {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+    * @brief One deadline in the heap
+    */
+    struct Entry {
+        Clock::time_point deadline; /**< Time of the retransmission */
+        int messageID; /**< ID of the message */
+    };
+
+    /**
+    * @brief Adds a deadline for the message.
+    * @param messageID ID of the message.
+    * @param deadline Time when the message should be retransmitted.
+    */
+    void schedule(int messageID, Clock::time_point deadline);
+
+    /**
+    * @brief Removes the earliest entry if its deadline has passed.
+    * @param now Current time.
+    * @param entry Output of the expired entry.
+    * @return true if an entry expired, false otherwise.
+    */
+    bool expired(Clock::time_point now, Entry &entry);
+
+    /**
+    * @brief Computes the timeout for poll from the earliest deadline.
+    * @param now Current time.
+    * @return Milliseconds until the earliest deadline (rounded up), -1 if there is none.
+    */
+    int timeout(Clock::time_point now) const;
+
+    /**
+    * @brief Checks if there are no deadlines.
+    * @return true if the heap is empty.
+    */
+    bool empty() const;
+
+    /**
+    * @brief Removes all deadlines.
+    */
+    void clear();
+
+private:
+    /**
+    * @brief Ordering of the heap, the earliest deadline on top
+    */
+    struct Later {
+        bool operator()(const Entry &a, const Entry &b) const {
+            return a.deadline > b.deadline;
+        }
+    };
+
+    std::priority_queue<Entry, std::vector<Entry>, Later> heap; /**< Pending deadlines */
+};
+
+#endif /* TIMER_HPP */
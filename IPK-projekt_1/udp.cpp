@@ -1,4 +1,6 @@
 #include "udp.hpp"
+#include "codec.hpp"
+#include "output.hpp"
 #include <iostream>
 #include <sstream>
 #include <sys/socket.h>
@@ -9,8 +11,6 @@
 #include <getopt.h>
 #include <algorithm> 
 #include <atomic>    
-#include <poll.h>
-#include <regex>
 #include <csignal>
 #include <cstdlib>
 #include <vector>
@@ -19,7 +19,13 @@
 
 using namespace std;
 
-UDP::UDP() : currentState(START),sockClose(sock), messageID(0), refMessageID(messageID){}
+// Reads a 16-bit ID in network byte order
+static uint16_t readID(const char* data) {
+    return (static_cast<uint8_t>(data[0]) << 8) | static_cast<uint8_t>(data[1]);
+}
+
+UDP::UDP() : sentMessages(pool), session(REPLY_TIMEOUT_MS), sockClose(sock), messageID(0), refMessageID(messageID), window(16), replyPendingID(-1),
+    metrics(threadMetrics()), stateClock(metrics){}
 
 void UDP::setServerAddress(const string& serverAddress, uint16_t port) {
     bzero((char *)&serverAddr, sizeof(serverAddr));
@@ -29,7 +35,7 @@ void UDP::setServerAddress(const string& serverAddress, uint16_t port) {
     struct hostent *server;
     server = gethostbyname(serverAddress.c_str());
     if (server == NULL) {
-        cerr << "Hostname resolution failed" << endl;
+        standardError().writeLine({"Hostname resolution failed"});
         //currentState = END;
         return;
     }
@@ -37,626 +43,368 @@ void UDP::setServerAddress(const string& serverAddress, uint16_t port) {
     bcopy((char *)server->h_addr, (char *)&serverAddr.sin_addr.s_addr, server->h_length);
 }
 
-void UDP::startCommunication(int sock, string &username, string &secret, string &displayName){
-    currentState = AUTH;
-    string input;
-    if (getline(cin, input)) {
-        stringstream ss(input);
-        string command, param1, param2, param3;
-        ss >> command >> param1 >> param2 >> param3;
-
-        if (command == "/help"){
-            cout << "To authorize, use:" << endl;
-            cout << "/auth username secret displayName" << endl;
-            startCommunication(sock, username, secret, displayName);
-        }
-        else if (command != "/auth"){
-            cerr << "ERR: Invalid command. Expected '/auth' or '/help'." << endl;
-            startCommunication(sock, username, secret, displayName);
-        }
-        else {
-            // Check constraints for username, secret, and displayName
-            regex usernameRegex("[A-Za-z0-9\\-]{1,20}");
-            regex secretRegex("[A-Za-z0-9\\-]{1,128}");
-            regex displayNameRegex("[\\x21-\\x7E]{1,20}");
-
-            if (!regex_match(param1, usernameRegex) || !regex_match(param2, secretRegex) || !regex_match(param3, displayNameRegex)) {
-                cerr << "ERR: Invalid input format. Use /auth username secret displayName" << endl;
-                startCommunication(sock, username, secret, displayName);
-            } else {
-                username = param1;
-                secret = param2;
-                displayName = param3;
-                createAuthMessage(sock, username, displayName, secret, messageID);
-            }
-        }
-    } else {
-        // If input is empty (EOF detected)
-        cerr << "EOF detected. Terminating." << endl;
-        currentState = END;
+void UDP::createConfirmMessage(int sock, int refMessageID) { 
+    metrics.messagesSent.add();
+    metrics.bytesSent.add(3);
+    if (batching) {
+        sender.queueConfirm(sock, serverAddr, refMessageID);
+        return;
     }
-}
 
-void UDP::createConfirmMessage(int sock, int refMessageID) { 
-    vector<unsigned char> message;
-    
     //(confirm 0x00)
-    message.push_back(0x00);
+    unsigned char message[3] = {0x00, static_cast<unsigned char>((refMessageID >> 8) & 0xFF), static_cast<unsigned char>(refMessageID & 0xFF)};
 
-    message.push_back((refMessageID >> 8) & 0xFF);
-    message.push_back(refMessageID & 0xFF);
-
-    int bytesSent = sendto(sock, message.data(), message.size(), 0, (struct sockaddr *) &serverAddr, sizeof(serverAddr));
+    int bytesSent = sendto(sock, message, sizeof(message), 0, (struct sockaddr *) &serverAddr, sizeof(serverAddr));
     if (bytesSent < 0) {
-        cerr << "Sendto confirm failed" << endl;
+        standardError().writeLine({"Sendto confirm failed"});
     }
 }
 
-void UDP::createAuthMessage(int sock, const string& username, const string& displayName, const string& secret, int messageID) {
-    vector<unsigned char> message;
-
-    //(AUTH 0x02)
-    message.push_back(0x02);
-
-    // Add messageID (2 bytes)
-    message.push_back((messageID >> 8) & 0xFF);
-    message.push_back(messageID & 0xFF);
-
-    for (char c : username) {
-        message.push_back(c);
-    }
-    message.push_back(0);
-
-    for (char c : displayName) {
-        message.push_back(c);
-    }
-    message.push_back(0);
-
-    for (char c : secret) {
-        message.push_back(c);
-    }
-    message.push_back(0);
-
-    send(sock, message);
+void UDP::createAuthMessage(int sock, string_view username, string_view displayName, string_view secret, int messageID) {
+    ClientMessage message = {};
+    message.kind = CLIENT_AUTH;
+    message.username = username;
+    message.displayName = displayName;
+    message.secret = secret;
+    sendMessage(sock, message, messageID);
 }
 
-void UDP::createJoinMessage(int sock, string& channelID, const string& displayName, int messageID) {
-    vector<unsigned char> message;
-
-    //(JOIN 0x03)
-    message.push_back(0x03);
-
-    // Add messageID (2 bytes)
-    message.push_back((messageID >> 8) & 0xFF);
-    message.push_back(messageID & 0xFF);
-
-    for (char c : channelID) {
-        message.push_back(c);
-    }
-    message.push_back(0);
-
-    for (char c : displayName) {
-        message.push_back(c);
-    }
-    message.push_back(0);
-
-    send(sock, message);
+void UDP::createJoinMessage(int sock, string_view channelID, string_view displayName, int messageID) {
+    ClientMessage message = {};
+    message.kind = CLIENT_JOIN;
+    message.channelID = channelID;
+    message.displayName = displayName;
+    sendMessage(sock, message, messageID);
 }
 
-void UDP::createMsgMessage(int sock, string& MessageContents, const string& displayName, int messageID) {
-    vector<unsigned char> message;
-
-    //(MSG 0x04)
-    message.push_back(0x04);
-
-    // Add messageID (2 bytes)
-    message.push_back((messageID >> 8) & 0xFF);
-    message.push_back(messageID & 0xFF);
+void UDP::createMsgMessage(int sock, string_view MessageContents, string_view displayName, int messageID) {
+    ClientMessage message = {};
+    message.kind = CLIENT_MSG;
+    message.content = MessageContents;
+    message.displayName = displayName;
+    sendMessage(sock, message, messageID);
+}
 
-    for (char c : displayName) {
-        message.push_back(c);
-    }
-    message.push_back(0);
+void UDP::createErrMessage(int sock, string_view MessageContents, string_view displayName, int messageID) { 
+    ClientMessage message = {};
+    message.kind = CLIENT_ERR;
+    message.content = MessageContents;
+    message.displayName = displayName;
+    sendMessage(sock, message, messageID);
+}
 
-    for (char c : MessageContents) {
-        message.push_back(c);
+void UDP::sendMessage(int sock, const ClientMessage &message, int messageID) {
+    PacketBuffer* buffer = pool.acquire();
+    if (!encodeDatagram(message, messageID, *buffer)) {
+        standardError().writeLine({"ERR: message is too long"});
+        pool.release(buffer);
+        return;
     }
-    message.push_back(0);
-
-    send(sock, message);
+    send(sock, buffer);
 }
 
-void UDP::createErrMessage(int sock, string& MessageContents, const string& displayName, int messageID) { 
-    vector<unsigned char> message;
-
-    //(ERR 0xFE)
-    message.push_back(0xFE);
-
-    // Add messageID (2 bytes)
-    message.push_back((messageID >> 8) & 0xFF);
-    message.push_back(messageID & 0xFF);
+void UDP::createByeMessage(int sock, int messageID) { 
+    ClientMessage message = {};
+    message.kind = CLIENT_BYE;
+    sendMessage(sock, message, messageID);
+}
 
-    for (char c : displayName) {
-        message.push_back(c);
+void UDP::send(int sock, PacketBuffer* message) {
+    // The ID is already encoded in the message, the next one can be assigned right away
+    messageID++;
+    if (!pendingMessages.empty() || !windowOpen()) {
+        pendingMessages.push_back(message);
+        return;
     }
-    message.push_back(0);
+    transmit(sock, message);
+}
 
-    for (char c : MessageContents) {
-        message.push_back(c);
+bool UDP::windowOpen() {
+    // A CONFIRMED AUTH or JOIN only waits for its REPLY, it does not occupy the window
+    if (sentMessages.countOf(SENT) >= window) {
+        return false;
     }
-    message.push_back(0);
-
-    send(sock, message);
+    // Nothing may overtake a message that waits for REPLY
+    return replyPendingID < 0 || sentMessages.find(replyPendingID) == nullptr;
 }
 
-void UDP::createByeMessage(int sock, int messageID) { 
-    vector<unsigned char> message;
-
-    //(BYE 0xFF)
-    message.push_back(0xFF);
-
-    // Add messageID (2 bytes)
-    message.push_back((messageID >> 8) & 0xFF);
-    message.push_back(messageID & 0xFF);
-
-    send(sock, message);
+void UDP::fillWindow(int sock) {
+    while (!pendingMessages.empty() && windowOpen()) {
+        PacketBuffer* message = pendingMessages.front();
+        pendingMessages.pop_front();
+        transmit(sock, message);
+    }
 }
 
-void UDP::send(int sock, const vector<unsigned char>& message) {
-    int bytesSent = sendto(sock, message.data(), message.size(), 0, (struct sockaddr *) &serverAddr, sizeof(serverAddr));
+void UDP::transmit(int sock, PacketBuffer* message) {
+    uint16_t id = readID(reinterpret_cast<const char*>(message->data) + 1);
+    // The slot is taken first, a message on the wire must be tracked for CONFIRM and retransmission
+    MessageInfo* messageSent = sentMessages.add(id);
+    if (messageSent == nullptr) {
+        standardError().writeLine({"ERR: too many unconfirmed messages"});
+        pool.release(message);
+        return;
+    }
+    messageSent->content = message;
+    int bytesSent = sendto(sock, message->data, message->length, 0, (struct sockaddr *) &serverAddr, sizeof(serverAddr));
     if (bytesSent < 0) {
-        cerr << "Sendto failed" << endl;
+        standardError().writeLine({"Sendto failed"});
+        sentMessages.retire(messageSent);
     } else {
-        MessageInfo messageSent;
-        messageSent.timer = chrono::steady_clock::now();
-        messageSent.retries = r;
-        messageSent.messageID = messageID;
-        messageSent.content = message;
-        messageSent.confirm = false;
-        sentMessages.push_back(messageSent);
-        messageID++;
+        metrics.messagesSent.add();
+        metrics.bytesSent.add(message->length);
+        messageSent->timer = chrono::steady_clock::now();
+        messageSent->firstSent = messageSent->timer;
+        messageSent->deadline = messageSent->timer + rtt.timeout(0);
+        messageSent->retries = r;
+        // AUTH and JOIN are answered by REPLY
+        messageSent->awaitsReply = message->data[0] == 0x02 || message->data[0] == 0x03;
+        if (messageSent->awaitsReply) {
+            replyPendingID = id;
+        }
+        retransmitTimer.schedule(id, messageSent->deadline);
+        updateGauges();
     }
 }
 
-void UDP::sendAgain(int sock, const vector<unsigned char>& message){
-   int bytesSent = sendto(sock, message.data(), message.size(), 0, (struct sockaddr *) &serverAddr, sizeof(serverAddr));
+void UDP::sendAgain(int sock, const PacketBuffer* message){
+    metrics.messagesSent.add();
+    metrics.bytesSent.add(message->length);
+    if (batching) {
+        sender.queue(sock, serverAddr, message->data, message->length);
+        return;
+    }
+   int bytesSent = sendto(sock, message->data, message->length, 0, (struct sockaddr *) &serverAddr, sizeof(serverAddr));
     if (bytesSent < 0) {
-        cerr << "Sendto again failed" << endl;
+        standardError().writeLine({"Sendto again failed"});
     } 
 }
 
-void UDP::handleMsg(char* buffer) {
-    //cout << "mesg" << endl;
-    uint16_t SmessageID = (buffer[1] << 8) | buffer[2];
+void UDP::beginBatch() {
+    batching = true;
+}
 
-    // Check if messageID is in messageIDsFromServer vector
-    if (find(messageIDsFromServer.begin(), messageIDsFromServer.end(), SmessageID) != messageIDsFromServer.end()) {
-        // Message ID found in messageIDsFromServer vector, skipping functionality
-        return;
+void UDP::endBatch(int sock) {
+    batching = false;
+    if (!sender.flush(sock)) {
+        standardError().writeLine({"Sendto failed"});
     }
+}
 
-    // Find the end of DisplayName field
-    int displayNameEnd = 3; // Starting from index 3
-    while (buffer[displayNameEnd] != '\0') {
-        ++displayNameEnd;
+int UDP::nextTimeout() const {
+    auto now = chrono::steady_clock::now();
+    int timeout = retransmitTimer.timeout(now);
+    if (!timerArmed) {
+        return timeout;
     }
+    auto remaining = chrono::duration_cast<chrono::milliseconds>(replyDeadline - now).count();
+    int replyTimeout = remaining > 0 ? static_cast<int>(remaining) + 1 : 0;
+    return timeout < 0 ? replyTimeout : min(timeout, replyTimeout);
+}
 
-    // Extract DisplayName field
-    string displayName(buffer + 3, buffer + displayNameEnd);
-
-    // Find the end of MessageContents field
-    int messageContentStart = displayNameEnd + 1;
-    int messageContentEnd = messageContentStart; // Start from displayNameEnd + 1
-    while (buffer[messageContentEnd] != '\0') {
-        ++messageContentEnd;
+bool UDP::processTimers(int sock) {
+    auto now = chrono::steady_clock::now();
+    // A CONFIRMED JOIN is no longer retransmitted, only this deadline ends the wait for its REPLY
+    if (timerArmed && now >= replyDeadline) {
+        timerArmed = false;
+        perform(session.timerExpired(), sock);
+    }
+    RetransmitTimer::Entry entry;
+    while (retransmitTimer.expired(now, entry)) {
+        MessageInfo* msg = sentMessages.find(entry.messageID);
+        // Skip entries of messages that were confirmed or retransmitted since the entry was added
+        if (msg == nullptr || msg->status != SENT || msg->deadline != entry.deadline) {
+            continue;
+        }
+        if (msg->retries > 0) {
+            sendAgain(sock, msg->content);
+            ++retransmissions;
+            metrics.retransmissions.add();
+            msg->retries--; // Decrement one retry
+            msg->timer = now;
+            // Exponential backoff, the timeout doubles with every retransmission
+            msg->deadline = now + rtt.timeout(r - msg->retries);
+            retransmitTimer.schedule(msg->messageID, msg->deadline);
+        } else {
+            // If the number of retries is 0, the message is lost
+            if (histograms != nullptr) {
+                histograms->attempts.record(r + 1);
+            }
+            metrics.expired.add();
+            sentMessages.retire(msg);
+            updateGauges();
+            return false;
+        }
     }
-
-    // Extract MessageContents field
-    string messageContent(buffer + messageContentStart, buffer + messageContentEnd);
-
-    cout << displayName << ": " << messageContent << endl; 
+    return true;
 }
 
-void UDP::handleErr(char* buffer) {
-    uint16_t SmessageID = (buffer[1] << 8) | buffer[2];
-
-    // Check if messageID is in messageIDsFromServer vector
-    if (find(messageIDsFromServer.begin(), messageIDsFromServer.end(), SmessageID) != messageIDsFromServer.end()) {
-        // Message ID found in messageIDsFromServer vector, skipping functionality
-        return;
+bool UDP::settleReply(uint16_t refMessageID) {
+    if (replyPendingID < 0 || refMessageID != replyPendingID) {
+        return false;
     }
-
-    // Find the end of DisplayName field
-    int serverNameEnd = 3; // Starting from index 3
-    while (buffer[serverNameEnd] != '\0') {
-        ++serverNameEnd;
+    MessageInfo* msg = sentMessages.find(refMessageID);
+    if (msg == nullptr || !msg->awaitsReply) {
+        return false;
     }
-
-    // Extract DisplayName field
-    string serverName(buffer + 3, buffer + serverNameEnd);
-
-    // Find the end of MessageContents field
-    int messageContentStart = serverNameEnd + 1;
-    int messageContentEnd = messageContentStart; // Start from displayNameEnd + 1
-    while (buffer[messageContentEnd] != '\0') {
-        ++messageContentEnd;
+    // Even if the REPLY overtook the CONFIRM the server has the message, waiting for
+    // a CONFIRM that may be lost would keep the window closed
+    if (histograms != nullptr) {
+        MessageHistograms::recordSince(histograms->reply, msg->firstSent);
+        if (msg->status == SENT) {
+            histograms->attempts.record(r - msg->retries + 1);
+        }
     }
-
-    // Extract MessageContents field
-    string messageContent(buffer + messageContentStart, buffer + messageContentEnd);
-
-    cerr << "ERR FROM " << serverName << ": " <<  messageContent << endl; 
+    sentMessages.retire(msg);
+    replyPendingID = -1;
+    return true;
 }
 
-bool UDP::handleReply(char* buffer) {
-    //cout << "reply" << endl;
-    uint16_t SmessageID = (buffer[1] << 8) | buffer[2];
-
-    // Check if messageID is in messageIDsFromServer vector
-    if (find(messageIDsFromServer.begin(), messageIDsFromServer.end(), SmessageID) != messageIDsFromServer.end()) {
-        // Message ID found in messageIDsFromServer vector, skipping functionality
-        return true;
-    }
-
-    uint8_t result = buffer[3];
-    uint16_t refMessageID = (buffer[4] << 8) | buffer[5];
-    char* messageContents = buffer + 6;
-
-    size_t contentLength = strlen(messageContents);
-
-    if (strchr(messageContents, '\0') != nullptr) {
-        ++contentLength;
+void UDP::handleConfirm(const char* buffer){
+    uint16_t refMessageID = readID(buffer + 1);
+    MessageInfo* msg = sentMessages.find(refMessageID);
+    if (msg == nullptr || msg->status != SENT) {
+        return;
     }
-
-    string messageContentString(messageContents, contentLength);
-
-    if (result == 1) {
-        cerr << "Success: " << messageContents << endl;
-        for (size_t i = 0; i < sentMessages.size(); ++i) {
-            if (sentMessages[i].messageID == refMessageID) {
-                if (!sentMessages[i].confirm) {
-                    sentMessages[i].confirm = true; 
-                } else {
-                    sentMessages.erase(sentMessages.begin() + i); 
-                }
-                return true;
-            }
-            /*else{
-                exit(-1);
-            }*/
+    // Karn's rule, only messages sent once give an unambiguous round trip time
+    if (msg->retries == r) {
+        auto measured = chrono::duration_cast<RttEstimator::Duration>(chrono::steady_clock::now() - msg->timer);
+        rtt.sample(measured);
+        if (confirmLatency != nullptr) {
+            confirmLatency->record(measured.count());
         }
-        return false;
+    }
+    if (histograms != nullptr) {
+        MessageHistograms::recordSince(histograms->confirm, msg->firstSent);
+        histograms->attempts.record(r - msg->retries + 1);
+    }
+    if (msg->awaitsReply) {
+        sentMessages.setStatus(msg, CONFIRMED);
     } else {
-        cerr << "Failure: " << messageContents << endl;
-        for (size_t i = 0; i < sentMessages.size(); ++i) {
-            if (sentMessages[i].messageID == refMessageID) {
-                sentMessages.erase(sentMessages.begin() + i);
-            }
-        }
-        return false;
+        sentMessages.retire(msg);
     }
 }
 
-void UDP::handleConfirm(char* buffer){
-    //cerr << "confirm" << endl;
-    uint16_t refMessageID = (buffer[1] << 8) | buffer[2];
-    for (size_t i = 0; i < sentMessages.size(); ++i) {
-        if (sentMessages[i].messageID == refMessageID) {
+void UDP::sendingFromClient(int sock, string_view line){
+    perform(session.userLine(line), sock);
+}
 
-            if (!sentMessages[i].confirm) {
-                sentMessages[i].confirm = true;
-            } else {
-                sentMessages.erase(sentMessages.begin() + i); 
-            }
-            break;
-        }
-    }
+void UDP::endOfInput(int sock){
+    perform(session.inputClosed(), sock);
 }
 
-void UDP::sendingFromClient(int sock, string &content, string &displayName){
-    string input;
-    if (!getline(cin, input)) {
-        currentState = END;
-        return;
-    }
+bool UDP::acceptsInput() const {
+    return !byeSent && session.state() != AUTH && pendingMessages.size() < window;
+}
 
-    if (input.empty()){
-        currentState = END;
+void UDP::receive(const char* data, size_t length, int sock) {
+    metrics.messagesReceived.add();
+    metrics.bytesReceived.add(length);
+    if (length < 3) {
+        return;
     }
-    else{
-        stringstream ss(input);
-        string command;
-        ss >> command;
-        if (currentState == OPEN){
-            if (command == "/auth"){
-                cerr << "ERR: You are already authorized. This command cannot be used." << endl;
-            }
-            else if (command == "/join") {
-                string channelID;
-                if (ss >> channelID && ss.eof()) {
-                    sendingJoin(sock, content, displayName, channelID);
-                } else {
-                    cerr << "ERR: Invalid usage of /join command. Usage: /join <channelID>" << endl;
-                }
-            }
-            else if (command == "/rename") {
-                string newName;
-                if (ss >> newName && ss.eof()) {
-                    displayName = newName;
-                } else {
-                    cerr << "ERR: Invalid usage of /rename command. Usage: /rename <newName>" << endl;
-                }
-            }
-            else if (command == "/help"){
-                cout << "To join channels, use:" << endl;
-                cout << "/join channelID" << endl;
-                cout << "To change your display name, use:" << endl;
-                cout << "/rename newName" << endl;
-            }
-            else{
-                content = input;
-                createMsgMessage(sock, content, displayName, messageID);
-            }
-        }
+    if (data[0] == 0x00) {
+        handleConfirm(data);
+        updateGauges();
+        return;
     }
-}
-
-void UDP::sendingJoin(int sock, string &content, string &displayName, string &channelID) {
-    createJoinMessage(sock, channelID, displayName, messageID);
-    bool result = false;
-    struct pollfd fds[1];
-    fds[0].fd = sock;
-    fds[0].events = POLLIN;
-    while (true) {
-        int ret = poll(fds, 1, 1000);
-        if (ret == -1) {
-            cerr << "poll() failed" << endl;
-            byeSent = true;
-            break;
-        }
-        if (fds[0].revents & POLLIN) {
-            char responseBuffer[1500];
-            struct sockaddr_in serverResponseAddr;
-            socklen_t serverResponseLen = sizeof(serverResponseAddr);
-
-            ssize_t responseBytesReceived = recvfrom(sock, responseBuffer, sizeof(responseBuffer), 0, (struct sockaddr *)&serverResponseAddr, &serverResponseLen);
-            if (responseBytesReceived < 0) {
-                cerr << "Error in receiving response from server" << endl;
-                break;
-            }
-
-            responseBuffer[responseBytesReceived] = '\0';
-
-            uint8_t messageType = responseBuffer[0];
-            uint16_t messageID = (responseBuffer[1] << 8) | responseBuffer[2];
-
-            switch (messageType) {
-                case 0x01:
-                    createConfirmMessage(sock, messageID);
-                    result = handleReply(responseBuffer);
-                    break; 
-                case 0x00:
-                    handleConfirm(responseBuffer);
-                    break;
-                case 0x04:
-                    createConfirmMessage(sock, messageID);
-                    handleMsg(responseBuffer);
-                    break; 
-            }
-            if (result) {
-                break;
-            }
-        }
-        for (auto it = sentMessages.begin(); it != sentMessages.end();) {
-            auto& msg = *it;
-
-            auto currentTime = std::chrono::steady_clock::now();
-            auto timeDiff = std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - msg.timer);
-
-            if (timeDiff.count() > d) {
-                if (msg.retries > 0) {
-                    if (!msg.confirm) {
-                        sendAgain(sock, msg.content);
-                        msg.retries--;
-                        msg.timer = std::chrono::steady_clock::now();
-                    } else {
-                        ++it;
-                        continue;
-                    }
-                } else {
-                    it = sentMessages.erase(it);
-                    currentState = END;
-                    result = true;
-                    break;
-                }
-            }
-            ++it;
-        }
-        if (result) {
-            break;
+    uint16_t serverMessageID = readID(data + 1);
+    // Every message is confirmed, also a duplicate whose CONFIRM got lost
+    createConfirmMessage(sock, serverMessageID);
+    if (byeSent || messageIDsFromServer.contains(serverMessageID)) {
+        // The session is over or the message was already handled
+        if (!byeSent) {
+            metrics.duplicates.add();
         }
+        return;
     }
-}
+    messageIDsFromServer.insert(serverMessageID);
 
-
-State UDP::nextState(State currentState, char* responseBuffer, int sock) {
-    uint8_t messageType = responseBuffer[0];
-    uint16_t messageID = (responseBuffer[1] << 8) | responseBuffer[2];
-
-    bool result = false;
-    switch (currentState){
-        case START:
-            return AUTH;
-        case AUTH:
-            switch (messageType) {
-                case 0x00:
-                    //cout << "CONFIRM" << endl;
-                    handleConfirm(responseBuffer);
-                    return AUTH;
-                case 0x01:
-                    //cout << "REPLY" << endl;
-                    createConfirmMessage(sock, messageID);
-                    result = handleReply(responseBuffer);
-                    messageIDsFromServer.push_back(messageID);
-                    if(result){
-                        return OPEN;
-                    }
-                    else{
-                        startCommunication(sock, username, secret, displayName);
-                        return AUTH;
-                    }
-                case 0xFE:
-                    //cout << "ERR" << endl;
-                    createConfirmMessage(sock, messageID);
-                    handleErr(responseBuffer);
-                    messageIDsFromServer.push_back(messageID);
-                    return END;
-                default:
-                    return END;
-                }
-        case OPEN:
-            switch (messageType) {
-                case 0x00:
-                    //cout << "CONFIRM" << endl;
-                    handleConfirm(responseBuffer);
-                    return OPEN;
-                case 0x01:
-                    //cout << "REPLY" << endl;
-                    createConfirmMessage(sock, messageID);
-                    result = handleReply(responseBuffer);
-                    messageIDsFromServer.push_back(messageID);
-                    if(result){
-                        return OPEN;
-                    }
-                    else{
-                        return AUTH;
-                    }
-                case 0x04:
-                    //cout << "MSG" << endl;
-                    createConfirmMessage(sock, messageID);
-                    handleMsg(responseBuffer);
-                    messageIDsFromServer.push_back(messageID);
-                    return OPEN;
-                case 0xFE:
-                    //cout << "ERR" << endl;
-                    createConfirmMessage(sock, messageID);
-                    handleErr(responseBuffer);
-                    messageIDsFromServer.push_back(messageID);
-                    return END;
-                case 0xFF:
-                    //cout << "BYE" << endl;
-                    createConfirmMessage(sock, messageID);
-                    return END;
-                default:
-                    cerr << "ERR: invalid message from server" << endl;
-                    string content = "Ivalid message from server";
-                    createErrMessage(sock, content, displayName, messageID);
-                    return END;
-                }
-        case ERROR:
-            return END;
-        default:
-            return START;
+    ServerMessage message;
+    uint16_t refMessageID = 0;
+    decodeDatagram(data, length, message, refMessageID);
+    if (message.kind == KIND_REPLY && !settleReply(refMessageID)) {
+        // Answers nothing the session waits for, it must not settle the pending AUTH or JOIN
+        metrics.unmatchedReplies.add();
+        return;
     }
+    perform(session.serverMessage(message), sock);
+    updateGauges();
 }
 
-void UDP::printState(State state) {
-    switch(state) {
-        case START:
-            cout << "Current state: START" << endl;
+void UDP::perform(const vector<Action> &actions, int sock) {
+    for (const Action &action : actions) {
+        switch (action.kind) {
+        case ACTION_SEND:
+            sendMessage(sock, action.message, messageID);
             break;
-        case AUTH:
-            cout << "Current state: AUTH" << endl;
-            break;
-        case OPEN:
-            cout << "Current state: OPEN" << endl;
+        case ACTION_PRINT:
+            if (!quiet) {
+                printAction(action);
+            }
             break;
-        case END:
-            cout << "Current state: END" << endl;
+        case ACTION_ARM_TIMER:
+            timerArmed = true;
+            replyDeadline = chrono::steady_clock::now() + chrono::milliseconds(action.timeoutMs);
             break;
-        case ERROR:
-            cout << "Current state: ERROR" << endl;
+        case ACTION_CANCEL_TIMER:
+            timerArmed = false;
             break;
-        default:
-            cout << "Unknown state" << endl;
+        case ACTION_END:
+            timerArmed = false;
+            closeSession(sock);
             break;
+        }
     }
+    stateClock.update(session.state());
 }
 
-void UDP::waitForConfirmation(int sock) {
-    struct pollfd fds[1];
-    fds[0].fd = sock;
-    fds[0].events = POLLIN;
-    while (true) {
-        int ret = poll(fds, 1, 1000);
-        if (ret == -1){
-            cerr << "poll() failed" << endl;
-            byeSent = true;
-            break;
-        }
-
-        if (fds[0].revents & POLLIN){
-            char responseBuffer[1500];
-            struct sockaddr_in serverResponseAddr;
-            socklen_t serverResponseLen = sizeof(serverResponseAddr);
-
-            ssize_t responseBytesReceived = recvfrom(sock, responseBuffer, sizeof(responseBuffer), 0, (struct sockaddr *)&serverResponseAddr, &serverResponseLen);
-            if (responseBytesReceived < 0) {
-                cerr << "Error in receiving response from server" << endl;
-                return;
-            }
-
-            responseBuffer[responseBytesReceived] = '\0';
+void UDP::closeSession(int sock) {
+    if (byeSent) {
+        return;
+    }
+    // Messages still waiting for the window go out before the BYE, a REPLY is no longer awaited
+    replyPendingID = -1;
+    createByeMessage(sock, messageID);
+    byeSent = true;
+    fillWindow(sock);
+}
 
-            uint8_t messageType = responseBuffer[0];
+void UDP::updateGauges() {
+    size_t inflight = sentMessages.size();
+    size_t serverIDs = messageIDsFromServer.size();
+    // A shrinking size gives a wrapped difference, the sum is still right modulo 2^64
+    metrics.inflight.add(inflight - reportedInflight);
+    metrics.serverIDs.add(serverIDs - reportedServerIDs);
+    reportedInflight = inflight;
+    reportedServerIDs = serverIDs;
+}
 
-            switch (messageType) {
-                case 0x00:
-                    handleConfirm(responseBuffer);
-                    byeSent = true;
-                    break;
-                default:
-                    cerr << "Unexpected message type while waiting for confirmation" << endl;
-                    break;
-            }
-        }
-        for (auto it = sentMessages.begin(); it != sentMessages.end();) {
-            auto& msg = *it;
-
-            auto currentTime = std::chrono::steady_clock::now();
-            auto timeDiff = std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - msg.timer);
-
-            if (timeDiff.count() > d) {
-                if (msg.retries > 0) {
-                    if (!msg.confirm) {
-                        sendAgain(sock, msg.content);
-                        msg.retries--;
-                        msg.timer = std::chrono::steady_clock::now(); 
-                    } else {
-                        ++it;
-                        continue;
-                    }
-                } else {
-                    it = sentMessages.erase(it);
-                    byeSent = true;
-                    break;
-                }
-            }
-            ++it;
-        }
-        if (byeSent) {
-            break;
-        }
-    }
+bool UDP::sessionClosed() const {
+    return byeSent && sentMessages.countOf(SENT) == 0 && pendingMessages.empty();
 }
 
 UDP::~UDP() {
-    createByeMessage(sockClose, messageID);
+    endBatch(sockClose);
     if (!byeSent) {
-        waitForConfirmation(sockClose);
+        // The event loop did not close the session, the BYE is sent without waiting for its CONFIRM
+        // and past the window, which may still be full when a message expired or receiving failed
+        ClientMessage message = {};
+        message.kind = CLIENT_BYE;
+        PacketBuffer* buffer = pool.acquire();
+        if (encodeDatagram(message, messageID, *buffer)) {
+            messageID++;
+            transmit(sockClose, buffer);
+        } else {
+            pool.release(buffer);
+        }
     }
     if (sockClose != -1) {
         close(sockClose);
         //cout << "Socket closed." << endl;
     }
+    // The session no longer holds anything, its time in the last state is accounted
+    metrics.inflight.sub(reportedInflight);
+    metrics.serverIDs.sub(reportedServerIDs);
+    stateClock.flush(session.state());
 }
\ No newline at end of file
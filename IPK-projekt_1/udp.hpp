@@ -7,59 +7,65 @@
 
 #include <iostream>
 #include <string>
-#include <regex>
 #include <sstream>
 #include <vector>
 #include <netinet/in.h>
 #include <chrono>
 #include <thread>
-
-/**
-* @brief Enumeration representing possible states of the UDP communication
-*/
-#ifndef STATE
-#define STATE
-enum State {
-    START, /**< Initial state */
-    AUTH,  /**< Authentication state */
-    OPEN,  /**< Communication open state */
-    END,   /**< End of communication state */
-    ERROR  /**< Error state */
-};
-#endif // STATE
-
-/**
-* @brief Structure representing information about a message
-*/
-struct MessageInfo {
-    int retries; /**< Number of retries for the message */
-    int messageID; /**< ID of the message */
-    std::vector<unsigned char> content; /**< Content of the message */
-    std::chrono::steady_clock::time_point timer; /**< Timer for the message */
-    bool confirm; /**< Flag indicating if the message has been confirmed */
-};
+#include <deque>
+#include "timer.hpp"
+#include "dedup.hpp"
+#include "pool.hpp"
+#include "inflight.hpp"
+#include "receiver.hpp"
+#include "sender.hpp"
+#include "rtt.hpp"
+#include "session.hpp"
+#include "histogram.hpp"
+#include "metrics.hpp"
 
 /**
 * @class UDP
 * @brief Class representing UDP communication functionality
+*
+* Encodes the messages requested by the session into datagrams and delivers them
+* reliably (CONFIRM, retransmission, send window), decodes received datagrams
+* and passes them to the session, and performs its actions.
 */
 class UDP {
 private: 
     int sock; /**< Socket descriptor */
 public:
-    std::vector<MessageInfo> sentMessages; /**< Vector of sent messages */
-    std::string username; /**< Username for authentication */
-    std::string secret; /**< Secret for authentication */
-    std::string displayName; /**< Display name */
-    State currentState; /**< Current state of the communication */
+    BufferPool pool; /**< Buffers for encoded messages */
+    InflightTable sentMessages; /**< Sent messages that are not confirmed or replied yet */
+    Session session; /**< Protocol state machine */
     int sockClose; /**< Socket descriptor for final bye message */
     int messageID; /**< Current message ID */
     int refMessageID; /**< Reference message ID */
+    size_t window; /**< Maximum number of messages in flight */
+    std::deque<PacketBuffer*> pendingMessages; /**< Encoded messages waiting for room in the window */
+    int replyPendingID; /**< ID of the last sent message that waits for REPLY, -1 if none */
+    bool timerArmed = false; /**< The session waits for the REPLY to JOIN with a deadline */
+    std::chrono::steady_clock::time_point replyDeadline; /**< Time by which the REPLY to JOIN must arrive */
     int r; /**< Number of retries */
-    int d;
+    int d; /**< Initial retransmission timeout in milliseconds */
+    RttEstimator rtt; /**< Retransmission timeout adapted to the measured round trip time */
     struct sockaddr_in serverAddr; /**< Server address */
-    std::vector<int> messageIDsFromServer; /**< Message IDs received from the server */
-    bool byeSent = false;
+    DuplicateWindow messageIDsFromServer; /**< Message IDs received from the server */
+    bool byeSent = false; /**< closeSession has sent the BYE */
+    RetransmitTimer retransmitTimer; /**< Deadlines of messages waiting for CONFIRM */
+    DatagramReceiver receiver; /**< Batched receive from the socket */
+    DatagramSender sender; /**< Batched send of CONFIRMs and retransmissions */
+    bool batching = false; /**< CONFIRMs and retransmissions are queued in sender */
+    bool quiet = false; /**< Lines of the session are not printed (load generator) */
+    long retransmissions = 0; /**< Number of retransmitted messages */
+    Histogram* confirmLatency = nullptr; /**< Receives the unambiguous CONFIRM round trip times in microseconds if set */
+    MessageHistograms* histograms = nullptr; /**< Receives the latencies and attempts of every sent message if set */
+    ThreadMetrics &metrics; /**< Counters of the thread that created the session */
+    StateClock stateClock; /**< Time spent in each state of the session */
+    size_t reportedInflight = 0; /**< Size of sentMessages included in metrics.inflight */
+    size_t reportedServerIDs = 0; /**< Size of messageIDsFromServer included in metrics.serverIDs */
+    static constexpr int REPLY_TIMEOUT_MS = 5000; /**< Time to wait for the REPLY to JOIN */
 
     /**
     * @brief Constructor for the UDP class
@@ -72,22 +78,6 @@ public:
     */
     void setServerAddress(const std::string& serverAddress, uint16_t port);
 
-    /**
-    * @brief Initiates communication with the server (first message).
-    * 
-    * This function handles the initial communication with the server. It prompts the user
-    * for input, expecting an authentication command (/auth) followed by username, secret, and
-    * display name. If the input matches the expected format, an authentication message is
-    * created and sent to the server. If the input is invalid or EOF (end-of-file) is detected,
-    * the function terminates the communication.
-    * 
-    * @param sock The socket for communication with the server.
-    * @param username Reference to the username variable to be set based on user input.
-    * @param secret Reference to the secret variable to be set based on user input.
-    * @param displayName Reference to the display name variable to be set based on user input.
-    */
-    void startCommunication(int sock, std::string &username, std::string &secret, std::string &displayName);
-    
     /**
     * @brief Creates and sends a confirmation message to the server.
     * 
@@ -112,7 +102,7 @@ public:
     * @param secret The secret key for authentication.
     * @param messageID The unique message ID associated with the message.
     */
-    void createAuthMessage(int sock, const std::string& username, const std::string& displayName, const std::string& secret, int messageID);
+    void createAuthMessage(int sock, std::string_view username, std::string_view displayName, std::string_view secret, int messageID);
 
     /**
     * @brief Creates and sends a JOIN message to the server.
@@ -125,7 +115,7 @@ public:
     * @param displayName The display name of the user joining the channel.
     * @param messageID The unique ID of the message.
     */
-    void createJoinMessage(int sock, std::string& channelID, const std::string& displayName, int messageID);
+    void createJoinMessage(int sock, std::string_view channelID, std::string_view displayName, int messageID);
 
     /**
     * @brief Creates and sends a MSG message to the server.
@@ -138,7 +128,7 @@ public:
     * @param displayName The display name of the user sending the message.
     * @param messageID The unique ID of the message.
     */
-    void createMsgMessage(int sock, std::string& MessageContents, const std::string& displayName, int messageID);
+    void createMsgMessage(int sock, std::string_view MessageContents, std::string_view displayName, int messageID);
 
     /**
     * @brief Creates and sends an ERR message to the server.
@@ -151,7 +141,15 @@ public:
     * @param displayName The display name of the user sending the error message.
     * @param messageID The unique ID of the error message.
     */
-    void createErrMessage(int sock, std::string& MessageContents, const std::string& displayName, int messageID);
+    void createErrMessage(int sock, std::string_view MessageContents, std::string_view displayName, int messageID);
+
+    /**
+    * @brief Encodes a message requested by the session and sends it through the window.
+    * @param sock Socket for communication with the server.
+    * @param message The message.
+    * @param messageID ID of the message.
+    */
+    void sendMessage(int sock, const ClientMessage &message, int messageID);
 
     /**
     * @brief Creates and sends a BYE message to the server.
@@ -164,18 +162,52 @@ public:
     */
     void createByeMessage(int sock, int messageID); 
 
+    /**
+    * @brief Passes a message to the send window.
+    * 
+    * The message is transmitted right away if the window has room, otherwise it waits in
+    * pendingMessages (in order) until fillWindow transmits it. The message ID is consumed
+    * in both cases. The call never blocks.
+    * 
+    * @param sock The socket for communication with the server.
+    * @param message The message to be sent, taken from pool.
+    * 
+    */
+    void send(int sock, PacketBuffer* message);
+
     /**
     * @brief Sends a message to the server and records it for tracking.
     * 
     * This function sends the provided message to the server using the specified socket.
     * It also records information about the sent message for tracking purposes, including
     * the number of retries, the timestamp for retry, and the message ID, etc.
+    * The slot in the table of sent messages is taken before the datagram is sent,
+    * if it is still used by an older message nothing is sent. The buffer is moved
+    * into the table without a copy and returns to the pool when the message is
+    * retired (or right away if sending fails).
     * 
     * @param sock The socket for communication with the server.
-    * @param message The message to be sent.
+    * @param message The message to be sent, taken from pool.
     * 
     */
-    void send(int sock, const std::vector<unsigned char>& message);
+    void transmit(int sock, PacketBuffer* message);
+
+    /**
+    * @brief Checks if another message may be transmitted.
+    *
+    * The window is open while fewer than window messages wait for CONFIRM and no
+    * AUTH or JOIN is waiting for its REPLY (messages are not sent ahead of it).
+    * closeSession stops waiting for the REPLY, so the BYE is not held back by it.
+    *
+    * @return true if a message can be transmitted.
+    */
+    bool windowOpen();
+
+    /**
+    * @brief Transmits pending messages while the window is open.
+    * @param sock The socket for communication with the server.
+    */
+    void fillWindow(int sock);
 
     /**
     * @brief Resends a message to the server.
@@ -187,144 +219,135 @@ public:
     * @param message The message to be resent.
     *
     */
-    void sendAgain(int sock, const std::vector<unsigned char>& message);
+    void sendAgain(int sock, const PacketBuffer* message);
 
     /**
-    * @brief Handles the reception and processing of a message from the server.
-    * 
-    * This function processes a message received from the server.
-    * It extracts the sender's display name and the message content from the received buffer
-    * and prints them to the standard output.
-    * 
-    * @param buffer server buffer.
-    * 
-    * The function first checks if the message ID is already present in the list of message IDs
-    * received from the server. If the message ID is found, the function skips further processing.
-    * 
-    * The display name and message content are then extracted from the buffer and printed
-    * to the standard output in the format "DisplayName: MessageContent".
+    * @brief Starts collecting CONFIRMs and retransmissions instead of sending them one by one.
     */
-    void handleMsg(char* buffer);
+    void beginBatch();
 
     /**
-    * @brief Handles the reception and processing of an error message from the server.
-    * 
-    * This function processes an error message received from the server.
-    * It extracts the server name and the error message content from the received buffer
-    * and prints them to the standard error output.
-    * 
-    * @param buffer server buffer.
-    * 
-    * The function first checks if the message ID is already present in the list of message IDs
-    * received from the server. If the message ID is found, the function skips further processing.
-    * 
-    * The server name and error message content are then extracted from the buffer and printed
-    * to the standard error output in the format "ERR FROM ServerName: ErrorMessage".
+    * @brief Sends everything collected since beginBatch with one sendmmsg call.
+    * @param sock The socket for communication with the server.
     */
-    void handleErr(char* buffer);
+    void endBatch(int sock);
 
     /**
-    * @brief Handles the reception and processing of a reply message from the server.
-    * 
-    * The function first checks if the message ID is already present in the list of message IDs
-    * received from the server. If the message ID is found, the function skips further processing.
-    * 
-    * The result, reference message ID, and message contents are then extracted from the buffer.
-    * If the result is a success (1), the function prints the message contents to the standard error output
-    * with the "Success" prefix and updates the confirmation status of the corresponding sent message
-    * in the list of sent messages. If the result is a failure (0), the function prints the message contents
-    * to the standard error output with the "Failure" prefix and removes the corresponding sent message
-    * from the list of sent messages.
-    * 
-    * @param buffer server buffer.
-    * @return true if the message is successfully handled, false otherwise.
+    * @brief Computes the poll timeout from the earliest retransmission deadline and the REPLY deadline.
+    * @return Milliseconds until the next deadline, -1 if no message waits for CONFIRM or REPLY.
+    */
+    int nextTimeout() const;
+
+    /**
+    * @brief Retransmits every message whose deadline has passed.
+    *
+    * Expired deadlines are taken from the retransmitTimer heap. A message that has not been
+    * confirmed is sent again and gets a new deadline from the RTT estimate (doubled for
+    * every retransmission), until its retries are used up. A passed REPLY deadline is
+    * handed to the session, which answers it with ERR and ends the session.
+    *
+    * @param sock The socket for communication with the server.
+    * @return false if a message was not confirmed after all retries, true otherwise.
+    */
+    bool processTimers(int sock);
+
+    /**
+    * @brief Retires the sent message answered by a REPLY.
+    *
+    * The REPLY proves the server has the message, also if it overtook the CONFIRM,
+    * so the message is no longer retransmitted and no longer blocks the window.
     *
+    * @param refMessageID ID of the message the REPLY answers.
+    * @return false if it is not the AUTH or JOIN waiting for REPLY, the REPLY is then dropped.
     */
-    bool handleReply(char* buffer);
+    bool settleReply(uint16_t refMessageID);
 
     /**
     * @brief Handles the confirmation of message receipt from the server.
     * 
     * The function extracts the reference message ID from the received buffer
-    * and iterates through the list of sent messages to find the corresponding
-    * message entry. If the message entry is found, the function updates
-    * its confirmation status. If the confirmation is received for the first time,
-    * the confirmation flag is set to true. If the confirmation is received again,
-    * indicating a replying and confirmation was received, and removes the corresponding sent message
-    * from the list of sent messages.
+    * and looks up the corresponding entry in the table of sent messages. A message
+    * that waits for a REPLY (AUTH, JOIN) becomes CONFIRMED, any other message
+    * is retired from the table. The CONFIRM
+    * of a message that was not retransmitted updates the RTT estimate.
     * 
     * @param buffer server buffer.
     * 
     */
-    void handleConfirm(char* buffer);
+    void handleConfirm(const char* buffer);
 
     /**
-    * @brief Manages message sending by the client to the server.
-    *
-    * This function reads input from the console and performs corresponding actions based on the current communication state.
-    * Possible commands include /auth for authentication, /join for joining a channel, /rename for changing the displayed name,
-    * and sending any arbitrary message as input text, if the input is empty, sets currentState to END.
-    *
+    * @brief Passes one line typed by the user to the session.
     * @param sock Socket for communication with the server.
-    * @param content Content of the message to be sent.
-    * @param displayName Display name of the client.
+    * @param line The line without the newline.
     */
-    void sendingFromClient(int sock, std::string &content, std::string &displayName);
+    void sendingFromClient(int sock, std::string_view line);
 
     /**
-    * @brief Sends a join message to the server and handles server responses.
-    *
-    * This function sends a join message to the server, indicating the client's intention to join a specific channel.
-    * It then waits for a response from the server, handling confirmation or rejection accordingly.
-    *
+    * @brief Passes the end of the user input to the session.
     * @param sock Socket for communication with the server.
-    * @param content Content of the join message (unused).
-    * @param displayName Display name of the client (unused).
-    * @param channelID ID of the channel the client wants to join.
     */
-    void sendingJoin(int sock, std::string &content, std::string &displayName, std::string &channelID);
+    void endOfInput(int sock);
 
     /**
-    * @brief Determines the next state based on the current state and server response.
+    * @brief Checks if the next user line may be passed to the session.
     *
-    * This function implements a finite state machine to determine the next state of the client based on the current state and the type of message received from the server.
-    * The client transitions between states according to predefined rules, responding to server messages appropriately.
+    * No line is passed while the REPLY to AUTH is pending or after closeSession.
+    * Messages typed while a JOIN waits for its REPLY are queued behind the send
+    * window, but at most window of them, so a fast input waits in its own buffer
+    * (or in the pipe) instead of the queue.
     *
-    * @param currentState The current state of the client, defined by the finite state machine.
-    * @param responseBuffer Buffer containing the server response.
-    * @param sock Socket for communication with the server.
-    * @return The next state of the client, as determined by the finite state machine.
+    * @return true if the session accepts the next line.
     */
-    State nextState(State currentState, char* responseBuffer, int sock);
+    bool acceptsInput() const;
 
     /**
-    * @brief Prints the current state of the client.
+    * @brief Handles one datagram received from the server.
     *
-    * This function is a utility for tracking the state of the client within the finite state machine.
-    * It prints out the current state of the client to the standard output stream.
-    * 
-    * This function was primarily used for testing and debugging purposes.
+    * CONFIRMs go to handleConfirm. Every other message is confirmed, duplicates are
+    * dropped and the rest is decoded and passed to the session. After closeSession
+    * messages are only confirmed.
     *
-    * @param state The current state of the client.
+    * @param data The datagram.
+    * @param length Size of the datagram.
+    * @param sock Socket for communication with the server.
     */
-    void printState(State state);
+    void receive(const char* data, size_t length, int sock);
 
     /**
-    * @brief Waits for confirmation from the server.
+    * @brief Performs the actions returned by the session.
+    * @param actions The actions.
+    * @param sock Socket for communication with the server.
+    */
+    void perform(const std::vector<Action> &actions, int sock);
+
+    /**
+    * @brief Starts closing the session.
     *
-    * This function uses poll to wait for incoming messages on the specified socket.
-    * It processes incoming messages and handles confirmations accordingly. 
-    * Additionally, it handles periodic resending of messages and removes messages 
-    * from the sentMessages vector if the maximum number of retries is reached.
+    * Messages still waiting for the window are transmitted, followed by the final BYE.
+    * REPLYs are no longer awaited. The event loop then passes incoming datagrams to
+    * handleClosing until sessionClosed returns true.
     *
-    * @param sock The socket to wait for confirmation on.
+    * @param sock The socket for communication with the server.
+    */
+    void closeSession(int sock);
+
+    /**
+    * @brief Checks if every message sent before and including the BYE is confirmed.
+    * @return true if the session is closed.
     */
-    
-    void waitForConfirmation(int sock);
+    bool sessionClosed() const;
+
+    /**
+    * @brief Brings the inflight and serverIDs gauges of the thread to the current sizes.
+    */
+    void updateGauges();
+
     /**
     * @brief Destructor for the UDP class
     *
-    * Close the sockClose and sends the last bye message to the server.
+    * Close the sockClose, sends the last bye message to the server if closeSession was not called.
+    * That BYE bypasses the send window and is not retransmitted.
     */
     ~UDP();
 };
@@ -0,0 +1,182 @@
+#include "uring.hpp"
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+Uring::Uring() : ringFd(-1), sqRing(MAP_FAILED), cqRing(MAP_FAILED), sqRingSize(0), cqRingSize(0),
+    sqes(nullptr), sqesSize(0), sqeTail(0), bufRing(nullptr), bufRingSize(0), bufTail(0) {
+}
+
+Uring::~Uring() {
+    if (bufRing != nullptr) {
+        munmap(bufRing, bufRingSize);
+    }
+    if (sqes != nullptr) {
+        munmap(sqes, sqesSize);
+    }
+    if (cqRing != MAP_FAILED && cqRing != sqRing) {
+        munmap(cqRing, cqRingSize);
+    }
+    if (sqRing != MAP_FAILED) {
+        munmap(sqRing, sqRingSize);
+    }
+    if (ringFd != -1) {
+        close(ringFd);
+    }
+}
+
+bool Uring::init(unsigned entries, unsigned completions) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    if (completions > 0) {
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = completions;
+    }
+    ringFd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ringFd < 0) {
+        // ENOSYS on old kernels, EPERM when io_uring is disabled
+        ringFd = -1;
+        return false;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single && cqRingSize > sqRingSize) {
+        sqRingSize = cqRingSize;
+    }
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        return false;
+    }
+    if (single) {
+        cqRing = sqRing;
+    } else {
+        cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            return false;
+        }
+    }
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *mapped = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    sqes = static_cast<struct io_uring_sqe*>(mapped);
+
+    char *sq = static_cast<char*>(sqRing);
+    sqFlags = reinterpret_cast<unsigned*>(sq + params.sq_off.flags);
+    sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqEntries = params.sq_entries;
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sqeTail = *sqTail;
+
+    char *cq = static_cast<char*>(cqRing);
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+bool Uring::ready() const {
+    return sqes != nullptr;
+}
+
+int Uring::fd() const {
+    return ringFd;
+}
+
+struct io_uring_sqe* Uring::getSqe() {
+    unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    if (sqeTail - head >= sqEntries) {
+        return nullptr;
+    }
+    struct io_uring_sqe *sqe = &sqes[sqeTail & sqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    ++sqeTail;
+    return sqe;
+}
+
+int Uring::submit(unsigned waitFor) {
+    unsigned tail = *sqTail;
+    unsigned toSubmit = sqeTail - tail;
+    for (; tail != sqeTail; ++tail) {
+        sqArray[tail & sqMask] = tail & sqMask;
+    }
+    __atomic_store_n(sqTail, sqeTail, __ATOMIC_RELEASE);
+    if (toSubmit == 0 && waitFor == 0) {
+        return 0;
+    }
+    unsigned flags = waitFor > 0 ? IORING_ENTER_GETEVENTS : 0;
+    int result;
+    do {
+        result = syscall(__NR_io_uring_enter, ringFd, toSubmit, waitFor, flags, nullptr, 0);
+    } while (result < 0 && errno == EINTR);
+    return result;
+}
+
+bool Uring::peek(struct io_uring_cqe &cqe) {
+    unsigned head = *cqHead;
+    if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+        if (!(__atomic_load_n(sqFlags, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW)) {
+            return false;
+        }
+        syscall(__NR_io_uring_enter, ringFd, 0, 0, IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+    }
+    cqe = cqes[head & cqMask];
+    __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool Uring::registerBuffers(uint16_t group, char *base, unsigned count, size_t stride, unsigned size) {
+    bufRingSize = count * sizeof(struct io_uring_buf);
+    void *mapped = mmap(nullptr, bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    // Addressed as an array of io_uring_buf, the flexible array of io_uring_buf_ring has a different offset in C++
+    bufRing = static_cast<struct io_uring_buf*>(mapped);
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(bufRing);
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        munmap(bufRing, bufRingSize);
+        bufRing = nullptr;
+        return false;
+    }
+    bufBase = base;
+    bufStride = stride;
+    bufSize = size;
+    bufMask = count - 1;
+    bufTail = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        recycleBuffer(i);
+    }
+    commitBuffers();
+    return true;
+}
+
+void Uring::recycleBuffer(uint16_t id) {
+    struct io_uring_buf *buf = &bufRing[bufTail & bufMask];
+    buf->addr = reinterpret_cast<uint64_t>(bufBase + id * bufStride);
+    buf->len = bufSize;
+    buf->bid = id;
+    ++bufTail;
+}
+
+void Uring::commitBuffers() {
+    __atomic_store_n(&bufRing[0].resv, bufTail, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,127 @@
+/**
+* @file uring.hpp
+* @brief Header file for the Uring class
+*/
+#ifndef URING_HPP
+#define URING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+
+/**
+* @class Uring
+* @brief Minimal io_uring instance driven by the raw system calls
+*
+* Maps the submission and completion rings and optionally one ring of
+* provided buffers. Only one thread may use an instance. If the kernel does
+* not support io_uring, init returns false and the caller keeps using the
+* ordinary system calls.
+*/
+class Uring {
+public:
+    /**
+    * @brief Constructor for the Uring class, the ring is created by init
+    */
+    Uring();
+
+    /**
+    * @brief Destructor for the Uring class, unmaps the rings and closes the descriptor
+    */
+    ~Uring();
+
+    /**
+    * @brief Creates the ring.
+    * @param entries Number of submission queue entries (power of 2).
+    * @param completions Number of completion queue entries (power of 2), 0 for twice entries.
+    * @return false if io_uring is not available.
+    */
+    bool init(unsigned entries, unsigned completions = 0);
+
+    /**
+    * @brief Checks if init succeeded.
+    * @return true if the ring can be used.
+    */
+    bool ready() const;
+
+    /**
+    * @brief File descriptor of the ring, readable when completions are waiting.
+    * @return Ring descriptor, -1 before init.
+    */
+    int fd() const;
+
+    /**
+    * @brief Takes a free submission queue entry, cleared.
+    * @return Entry to fill, nullptr if the queue is full.
+    */
+    struct io_uring_sqe* getSqe();
+
+    /**
+    * @brief Submits all prepared entries with one io_uring_enter call.
+    * @param waitFor Number of completions to wait for.
+    * @return Number of submitted entries, -1 on error.
+    */
+    int submit(unsigned waitFor = 0);
+
+    /**
+    * @brief Takes one completion without blocking.
+    *
+    * Completions the kernel could not fit into the ring are flushed into it first.
+    *
+    * @param cqe Filled with the completion.
+    * @return false if no completion is waiting.
+    */
+    bool peek(struct io_uring_cqe &cqe);
+
+    /**
+    * @brief Registers a ring of provided buffers for IOSQE_BUFFER_SELECT.
+    * @param group Buffer group ID.
+    * @param base Memory of count buffers of stride bytes.
+    * @param count Number of buffers (power of 2).
+    * @param stride Distance between buffers.
+    * @param size Usable size of each buffer.
+    * @return false if the kernel does not support provided buffer rings.
+    */
+    bool registerBuffers(uint16_t group, char *base, unsigned count, size_t stride, unsigned size);
+
+    /**
+    * @brief Gives a provided buffer back to the kernel, published by commitBuffers.
+    * @param id Buffer ID from the completion flags.
+    */
+    void recycleBuffer(uint16_t id);
+
+    /**
+    * @brief Publishes the recycled buffers.
+    */
+    void commitBuffers();
+
+private:
+    int ringFd; /**< Ring descriptor */
+    void *sqRing; /**< Mapped submission ring */
+    void *cqRing; /**< Mapped completion ring, same as sqRing with IORING_FEAT_SINGLE_MMAP */
+    size_t sqRingSize; /**< Size of the sqRing mapping */
+    size_t cqRingSize; /**< Size of the cqRing mapping */
+    struct io_uring_sqe *sqes; /**< Mapped submission queue entries */
+    size_t sqesSize; /**< Size of the sqes mapping */
+    unsigned *sqFlags; /**< Ring state set by the kernel (IORING_SQ_CQ_OVERFLOW) */
+    unsigned *sqHead; /**< Consumed by the kernel */
+    unsigned *sqTail; /**< Published to the kernel */
+    unsigned sqMask; /**< Index mask of the submission ring */
+    unsigned sqEntries; /**< Size of the submission ring */
+    unsigned *sqArray; /**< Indexes of submitted entries */
+    unsigned sqeTail; /**< Prepared but not yet published */
+    unsigned *cqHead; /**< Consumed by us */
+    unsigned *cqTail; /**< Produced by the kernel */
+    unsigned cqMask; /**< Index mask of the completion ring */
+    struct io_uring_cqe *cqes; /**< Completion entries */
+
+    struct io_uring_buf *bufRing; /**< Provided buffers, nullptr if none, the tail overlays bufRing[0].resv */
+    size_t bufRingSize; /**< Size of the bufRing mapping */
+    char *bufBase; /**< Memory of the provided buffers */
+    size_t bufStride; /**< Distance between provided buffers */
+    unsigned bufSize; /**< Usable size of a provided buffer */
+    unsigned bufMask; /**< Index mask of the buffer ring */
+    uint16_t bufTail; /**< Recycled but not yet published */
+};
+
+#endif /* URING_HPP */
@@ -0,0 +1,159 @@
+/**
+* @file validate.hpp
+* @brief Compile-time character classes and length limits of the protocol fields
+*/
+#ifndef VALIDATE_HPP
+#define VALIDATE_HPP
+
+#include <cstddef>
+#include <string_view>
+#include "scan.hpp"
+
+/**
+* @class CharClass
+* @brief Set of allowed bytes, built at compile time
+*
+* A check is one table lookup per byte, no regex is compiled or interpreted.
+* A class that is one contiguous range is checked with bytesInRange instead,
+* many bytes at a time.
+*/
+class CharClass {
+public:
+    constexpr CharClass() : members{}, first(0), last(0), contiguous(false) {}
+
+    /**
+    * @brief Adds a range of characters.
+    * @param first First character of the range.
+    * @param last Last character of the range.
+    * @return The class with the range added.
+    */
+    constexpr CharClass range(char first, char last) const {
+        CharClass added = *this;
+        for (int c = static_cast<unsigned char>(first); c <= static_cast<unsigned char>(last); ++c) {
+            added.members[c] = true;
+        }
+        return added.summarized();
+    }
+
+    /**
+    * @brief Adds single characters.
+    * @param list The characters.
+    * @return The class with the characters added.
+    */
+    constexpr CharClass chars(std::string_view list) const {
+        CharClass added = *this;
+        for (char c : list) {
+            added.members[static_cast<unsigned char>(c)] = true;
+        }
+        return added.summarized();
+    }
+
+    /**
+    * @brief Checks if a character belongs to the class.
+    * @param c The character.
+    * @return true if it is allowed.
+    */
+    constexpr bool contains(char c) const {
+        return members[static_cast<unsigned char>(c)];
+    }
+
+    /**
+    * @brief Checks if the class is one range of values, from lowest to highest.
+    * @return true for a contiguous class.
+    */
+    constexpr bool isRange() const {
+        return contiguous;
+    }
+
+    /**
+    * @brief Lowest member.
+    * @return The value.
+    */
+    constexpr unsigned char lowest() const {
+        return first;
+    }
+
+    /**
+    * @brief Highest member.
+    * @return The value.
+    */
+    constexpr unsigned char highest() const {
+        return last;
+    }
+
+private:
+    /**
+    * @brief Finds the lowest and highest member and whether everything between is a member.
+    * @return The class with the summary filled in.
+    */
+    constexpr CharClass summarized() const {
+        CharClass result = *this;
+        int low = 0;
+        while (low < 256 && !members[low]) {
+            ++low;
+        }
+        int high = 255;
+        while (high >= low && !members[high]) {
+            --high;
+        }
+        result.contiguous = low <= high;
+        for (int c = low; c <= high; ++c) {
+            result.contiguous &= members[c];
+        }
+        result.first = static_cast<unsigned char>(low <= high ? low : 0);
+        result.last = static_cast<unsigned char>(low <= high ? high : 0);
+        return result;
+    }
+
+    bool members[256]; /**< Membership of every byte value */
+    unsigned char first; /**< Lowest member */
+    unsigned char last; /**< Highest member */
+    bool contiguous; /**< Every value from first to last is a member */
+};
+
+/**
+* @brief Rule of one protocol field: allowed characters and 1 to maxLength of them
+*/
+struct FieldRule {
+    CharClass characters; /**< Allowed characters */
+    size_t maxLength; /**< Maximum length */
+
+    /**
+    * @brief Checks a value of the field.
+    * @param value The value.
+    * @return true if it is not empty, not too long and every character is allowed.
+    */
+    constexpr bool matches(std::string_view value) const {
+        if (value.empty() || value.size() > maxLength) {
+            return false;
+        }
+        // Long values of a printable range (contents) are checked by the vector unit at run time,
+        // short ones are done before the call would return
+        if (!__builtin_is_constant_evaluated() && characters.isRange() && value.size() >= 32) {
+            return bytesInRange(value.data(), value.data() + value.size(), characters.lowest(), characters.highest());
+        }
+        // No early exit, the loop is unrolled and the rejected values are rare
+        bool allowed = true;
+        for (char c : value) {
+            allowed &= characters.contains(c);
+        }
+        return allowed;
+    }
+};
+
+constexpr CharClass ALNUM_DASH = CharClass().range('A', 'Z').range('a', 'z').range('0', '9').chars("-");
+constexpr CharClass PRINTABLE = CharClass().range('\x21', '\x7E');
+
+constexpr FieldRule USERNAME_RULE = {ALNUM_DASH, 20}; /**< Username, [A-Za-z0-9-]{1,20} */
+constexpr FieldRule SECRET_RULE = {ALNUM_DASH, 128}; /**< Secret, [A-Za-z0-9-]{1,128} */
+constexpr FieldRule CHANNEL_RULE = {ALNUM_DASH.chars("_."), 20}; /**< ChannelID, also '_' and '.' as in discord.general */
+constexpr FieldRule DISPLAY_NAME_RULE = {PRINTABLE, 20}; /**< DisplayName, [\x21-\x7E]{1,20} */
+constexpr FieldRule CONTENT_RULE = {PRINTABLE.chars(" "), 1400}; /**< MessageContent, [\x20-\x7E]{1,1400} */
+
+static_assert(USERNAME_RULE.matches("xlogin00") && !USERNAME_RULE.matches("x_login"), "username rule");
+static_assert(CHANNEL_RULE.matches("discord.general") && !CHANNEL_RULE.matches("two words"), "channel rule");
+static_assert(DISPLAY_NAME_RULE.matches("Alice!") && !DISPLAY_NAME_RULE.matches("Alice Smith"), "display name rule");
+static_assert(CONTENT_RULE.characters.isRange() && !USERNAME_RULE.characters.isRange(), "range detection");
+static_assert(CONTENT_RULE.matches("Hello world") && !CONTENT_RULE.matches("tab\there"), "content rule");
+
+#endif /* VALIDATE_HPP */